@@ -0,0 +1,64 @@
+/*
+ * bench.c
+ *
+ * Timing and allocation counting for the benchmarks.
+ */
+#include "common.h"
+#include "bench.h"
+
+atomic_size_t bench_allocs;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *__wrap_malloc(size_t size)
+{
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t size)
+{
+    atomic_fetch_add_explicit(&bench_allocs, 1, memory_order_relaxed);
+    return __real_realloc(p, size);
+}
+
+/*
+ * double bench_now(void)
+ *  Monotonic time in nanoseconds.
+ */
+double bench_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+void bench_start(struct bench_s *b, const char *name, size_t ops)
+{
+    b->name = name;
+    b->ops = ops ? ops : 1;
+    b->allocs = atomic_load(&bench_allocs);
+    b->start = bench_now();
+}
+
+void bench_stop(struct bench_s *b)
+{
+    double ns = bench_now() - b->start;
+    size_t allocs = atomic_load(&bench_allocs) - b->allocs;
+
+    printf("bench=%s", b->name);
+    if(b->threads)
+        printf(" threads=%u", b->threads);
+
+    printf(" ops=%lu ns_per_op=%.2f allocs_per_op=%.3f\n", b->ops,
+        ns / b->ops, (double) allocs / b->ops);
+    fflush(stdout);
+}
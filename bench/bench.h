@@ -0,0 +1,31 @@
+#ifndef BENCH_H_
+#define BENCH_H_
+
+/*
+ * bench.h
+ *
+ * A tiny harness for the benchmarks in this directory. Time a run with
+ * bench_start and bench_stop, which prints one line per run:
+ *
+ * bench=<name> [threads=<n>] ops=<n> ns_per_op=<x> allocs_per_op=<x>
+ *
+ * Allocations are counted by wrapping malloc, calloc and realloc at link
+ * time (see the Makefile), so they include the ones made inside the
+ * library.
+ */
+#include <stdatomic.h>
+
+struct bench_s {
+    const char *name;
+    unsigned threads;
+    size_t ops, allocs;
+    double start;
+};
+
+extern atomic_size_t bench_allocs;
+
+double bench_now(void);
+void bench_start(struct bench_s *b, const char *name, size_t ops);
+void bench_stop(struct bench_s *b);
+
+#endif
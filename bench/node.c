@@ -0,0 +1,384 @@
+/*
+ * node.c
+ *
+ * Benchmarks for the basic node operations. Run with make bench, which
+ * builds them with optimization. Each run prints one line in the format
+ * described in bench.h.
+ */
+#include "common.h"
+#include "bench.h"
+
+#define BENCH_N (1 << 20)
+#define BENCH_TREE_N (1 << 17)
+#define BENCH_SORTED_N (1 << 12)
+#define BENCH_TABLE_N 1024
+#define BENCH_GRAPH_N (1 << 18)
+#define BENCH_GRAPH_DEGREE 8
+
+static struct node_s *nodes[BENCH_N];
+static size_t visited;
+
+static void visit(struct node_s *n)
+{
+    visited++;
+}
+
+/*
+ * Fill nodes with n integer nodes, holding 0 to n - 1 in order or shuffled.
+ */
+static void bench_ints(size_t n, bool shuffle)
+{
+    struct node_s *t;
+    size_t i, j;
+
+    for(i = 0; i < n; i++)
+        nodes[i] = int_node_new((int) i);
+
+    for(i = n - 1; shuffle && i > 0; i--) {
+        j = ur(i);
+        t = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = t;
+    }
+}
+
+static void bench_new_free(bool pooled)
+{
+    struct bench_s b = { 0 };
+    size_t i;
+
+    node_pool_enable(pooled);
+
+    bench_start(&b, pooled ? "int_new_pooled" : "int_new", BENCH_N);
+    for(i = 0; i < BENCH_N; i++)
+        nodes[i] = int_node_new((int) i);
+    bench_stop(&b);
+
+    bench_start(&b, pooled ? "int_free_pooled" : "int_free", BENCH_N);
+    for(i = 0; i < BENCH_N; i++)
+        node_free_all(nodes[i]);
+    bench_stop(&b);
+
+    node_pool_enable(false);
+    node_pool_reset();
+}
+
+static void bench_table(void)
+{
+    struct node_s *t = int_node_new(0), *c = int_node_new(1);
+    struct bench_s b = { 0 };
+    size_t i;
+
+    bench_start(&b, "push_pop", BENCH_N);
+    for(i = 0; i < BENCH_N; i++) {
+        node_push(t, c);
+        node_pop(t);
+    }
+    bench_stop(&b);
+
+    /*
+     * Fill a table, then keep moving children in and out of random slots.
+     */
+    for(i = 0; i < BENCH_TABLE_N; i++)
+        node_push(t, int_node_new((int) i));
+
+    bench_start(&b, "put_release", BENCH_N);
+    for(i = 0; i < BENCH_N; i++) {
+        size_t index = ur(BENCH_TABLE_N - 1);
+        node_put(t, index, node_release(t, index));
+    }
+    bench_stop(&b);
+
+    bench_start(&b, "release_all", BENCH_TABLE_N);
+    for(i = BENCH_TABLE_N; i > 0; i--)
+        node_free_all(node_release(t, i - 1));
+    bench_stop(&b);
+
+    node_free_all(c);
+    node_free_all(t);
+}
+
+static void bench_trees(void)
+{
+    struct node_s *root, *n;
+    struct bench_s b = { 0 };
+    size_t i;
+
+    bench_ints(BENCH_TREE_N, true);
+    bench_start(&b, "bst_insert_random", BENCH_TREE_N - 1);
+    for(i = 1; i < BENCH_TREE_N; i++)
+        node_bst_insert(nodes[0], nodes[i]);
+    bench_stop(&b);
+    node_free_all(nodes[0]);
+
+    bench_ints(BENCH_TREE_N, true);
+    bench_start(&b, "bst_insert_int_random", BENCH_TREE_N - 1);
+    for(i = 1; i < BENCH_TREE_N; i++)
+        node_bst_insert_int(nodes[0], nodes[i]);
+    bench_stop(&b);
+    node_free_all(nodes[0]);
+
+    bench_ints(BENCH_SORTED_N, false);
+    bench_start(&b, "bst_insert_sorted", BENCH_SORTED_N - 1);
+    for(i = 1; i < BENCH_SORTED_N; i++)
+        node_bst_insert(nodes[0], nodes[i]);
+    bench_stop(&b);
+    node_free_all(nodes[0]);
+
+    bench_ints(BENCH_TREE_N, true);
+    root = 0;
+    bench_start(&b, "avl_insert_random", BENCH_TREE_N);
+    for(i = 0; i < BENCH_TREE_N; i++)
+        node_avl_insert(&root, nodes[i]);
+    bench_stop(&b);
+
+    bench_start(&b, "avl_find", BENCH_TREE_N);
+    for(i = 0; i < BENCH_TREE_N; i++)
+        node_avl_find(root, nodes[i]);
+    bench_stop(&b);
+
+    bench_start(&b, "avl_find_int", BENCH_TREE_N);
+    for(i = 0; i < BENCH_TREE_N; i++)
+        node_avl_find_int(root, nodes[i]);
+    bench_stop(&b);
+
+    visited = 0;
+    bench_start(&b, "in_order", BENCH_TREE_N);
+    node_in_order(root, visit);
+    bench_stop(&b);
+
+    bench_start(&b, "bt_loop", BENCH_TREE_N);
+    node_bt_loop(n, root, NODE_POST_ORDER)
+        visited++;
+    bench_stop(&b);
+
+    bench_start(&b, "free_tree", BENCH_TREE_N);
+    node_free_all(root);
+    bench_stop(&b);
+
+    bench_ints(BENCH_TREE_N, true);
+    bench_start(&b, "bst_build_random", BENCH_TREE_N);
+    root = node_bst_build(nodes, BENCH_TREE_N);
+    bench_stop(&b);
+    node_free_all(root);
+}
+
+static void bench_stack(void)
+{
+    struct node_s *s = 0, *n = int_node_new(0);
+    struct bench_s b = { 0 };
+    size_t i;
+
+    bench_start(&b, "stack_push", BENCH_N);
+    for(i = 0; i < BENCH_N; i++)
+        stack_push(&s, n);
+    bench_stop(&b);
+
+    bench_start(&b, "stack_pop", BENCH_N);
+    for(i = 0; i < BENCH_N; i++)
+        stack_pop(&s);
+    bench_stop(&b);
+
+    for(i = 0; i < BENCH_N; i++)
+        q_en(&s, n);
+
+    bench_start(&b, "queue_en_de", BENCH_N);
+    for(i = 0; i < BENCH_N; i++) {
+        q_en(&s, n);
+        q_de(&s);
+    }
+    bench_stop(&b);
+
+    while(q_de(&s))
+        ;
+
+    /*
+     * A queue which is drained after every item, as a work queue often
+     * is, and the same for a stack.
+     */
+    bench_start(&b, "queue_en_de_empty", BENCH_N);
+    for(i = 0; i < BENCH_N; i++) {
+        q_en(&s, n);
+        q_de(&s);
+    }
+    bench_stop(&b);
+
+    bench_start(&b, "stack_push_pop_empty", BENCH_N);
+    for(i = 0; i < BENCH_N; i++) {
+        stack_push(&s, n);
+        stack_pop(&s);
+    }
+    bench_stop(&b);
+
+    node_free_all(n);
+}
+
+static void bench_strings(void)
+{
+    const size_t sizes[] = { 8, 15, 16, 64, 256, 4096 };
+    static char buf[4097], name[64];
+    struct bench_s b = { 0 };
+    size_t i, j, n;
+
+    memset(buf, 'x', sizeof(buf) - 1);
+
+    for(j = 0; j < sizeof(sizes) / sizeof(*sizes); j++) {
+        n = BENCH_N / (1 + sizes[j] / 256);
+
+        snprintf(name, sizeof(name), "str_new_%lu", sizes[j]);
+        bench_start(&b, name, n);
+        for(i = 0; i < n; i++)
+            nodes[i] = str_node_new_len(buf, sizes[j]);
+        bench_stop(&b);
+
+        for(i = 0; i < n; i++)
+            node_free_all(nodes[i]);
+
+        str_intern_enable(true);
+        snprintf(name, sizeof(name), "str_new_interned_%lu", sizes[j]);
+        bench_start(&b, name, n);
+        for(i = 0; i < n; i++)
+            nodes[i] = str_node_new_len(buf, sizes[j]);
+        bench_stop(&b);
+
+        for(i = 0; i < n; i++)
+            node_free_all(nodes[i]);
+
+        str_intern_enable(false);
+    }
+}
+
+static void bench_graph(void)
+{
+    struct node_s *g = int_node_new(0);
+    struct graph_s *f;
+    struct bench_s b = { 0 }, p = { .threads = 4 };
+    size_t i, j, *dist = (size_t *) malloc(sizeof(size_t) * BENCH_GRAPH_N);
+    double *weights = (double *) malloc(sizeof(double) * BENCH_GRAPH_N);
+
+    for(i = 0; i < BENCH_GRAPH_N; i++)
+        node_push(g, int_node_new((int) i));
+
+    for(i = 0; i < BENCH_GRAPH_N; i++)
+        for(j = 0; j < BENCH_GRAPH_DEGREE; j++)
+            node_push(node_at(g, i), edge_node_new(
+                node_at(g, ur(BENCH_GRAPH_N - 1)), 1 + ur(99)));
+
+    bench_start(&b, "graph_freeze", BENCH_GRAPH_N);
+    f = node_graph_freeze(g);
+    bench_stop(&b);
+
+    bench_start(&b, "graph_bfs", BENCH_GRAPH_N);
+    graph_bfs(f, 0, dist);
+    bench_stop(&b);
+
+    bench_start(&p, "graph_bfs_parallel", BENCH_GRAPH_N);
+    graph_bfs_parallel(f, 0, dist, p.threads);
+    bench_stop(&p);
+
+    bench_start(&b, "graph_dfs", BENCH_GRAPH_N);
+    graph_dfs(f, 0, dist);
+    bench_stop(&b);
+
+    bench_start(&b, "graph_components", BENCH_GRAPH_N);
+    graph_components(f, dist);
+    bench_stop(&b);
+
+    bench_start(&b, "graph_dijkstra", BENCH_GRAPH_N);
+    graph_dijkstra(f, 0, weights, dist);
+    bench_stop(&b);
+
+    graph_free(f);
+    node_free_all(g);
+    free(dist);
+    free(weights);
+}
+
+static void bench_serial(void)
+{
+    char path[] = "/tmp/bench_node_XXXXXX";
+    struct node_s *root;
+    struct node_view_s *v;
+    struct bench_s b = { 0 };
+    int fd = mkstemp(path);
+
+    if(fd < 0)
+        return;
+
+    close(fd);
+    bench_ints(BENCH_TREE_N, true);
+    root = node_bst_build(nodes, BENCH_TREE_N);
+
+    bench_start(&b, "node_save", BENCH_TREE_N);
+    node_save(root, path);
+    bench_stop(&b);
+    node_free_all(root);
+
+    bench_start(&b, "node_load", BENCH_TREE_N);
+    root = node_load(path);
+    bench_stop(&b);
+    node_free_all(root);
+
+    bench_start(&b, "node_view_open", BENCH_TREE_N);
+    v = node_view_open(path);
+    bench_stop(&b);
+    node_view_close(v);
+
+    unlink(path);
+}
+
+static void bench_import(void)
+{
+    char path[] = "/tmp/bench_node_XXXXXX";
+    struct node_import_s o = { .weighted = true };
+    struct node_s *g;
+    struct bench_s b = { 0 };
+    size_t i;
+    int fd = mkstemp(path);
+    FILE *f = fd < 0 ? 0 : fdopen(fd, "w");
+
+    if(!f)
+        return;
+
+    for(i = 0; i < BENCH_N; i++)
+        fprintf(f, "vertex%u\tvertex%u\t%u\n", ur(BENCH_GRAPH_N - 1),
+            ur(BENCH_GRAPH_N - 1), ur(99));
+    fclose(f);
+
+    bench_start(&b, "import_graph", BENCH_N);
+    g = node_import_graph(path, &o);
+    bench_stop(&b);
+    node_free_all(g);
+
+    o.presize = true;
+    bench_start(&b, "import_graph_presized", BENCH_N);
+    g = node_import_graph(path, &o);
+    bench_stop(&b);
+    node_free_all(g);
+
+    node_pool_enable(true);
+    bench_start(&b, "import_graph_presized_pooled", BENCH_N);
+    g = node_import_graph(path, &o);
+    bench_stop(&b);
+    node_pool_enable(false);
+    node_pool_reset();
+
+    unlink(path);
+}
+
+int main(int argc, char const *argv[])
+{
+    init_random();
+
+    bench_new_free(false);
+    bench_new_free(true);
+    bench_table();
+    bench_trees();
+    bench_stack();
+    bench_strings();
+    bench_graph();
+    bench_serial();
+    bench_import();
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * queue.c
+ *
+ * Contention benchmark for the queues in lfq.h, against q_en/q_de
+ * behind a global mutex.
+ *
+ * For every thread count from 1 up to the number of cores (or the
+ * count given on the command line), run that many producers and that
+ * many consumers passing BENCH_OPS nodes through a single queue, and
+ * print one line per run:
+ *
+ * bench=<name> threads=<n> ops=<n> ns_per_op=<x> allocs_per_op=<x>
+ */
+#include "common.h"
+#include "bench.h"
+#include <unistd.h>
+
+#define BENCH_OPS (1 << 20)
+#define BENCH_QUEUE_SIZE 1024
+
+enum bench_kind_e {
+    BENCH_MUTEX,
+    BENCH_MPMC,
+    BENCH_SPSC
+};
+
+static const char *bench_names[] = { "queue_mutex", "queue_mpmc", "queue_spsc" };
+
+static struct queue_bench_s {
+    enum bench_kind_e kind;
+    unsigned threads;
+    struct node_s *item, *q;
+    pthread_mutex_t lock;
+    struct lfq_s *mpmc;
+    struct spsc_s *spsc;
+    atomic_size_t taken;
+} bench;
+
+static bool bench_en(struct node_s *n)
+{
+    switch(bench.kind) {
+        case BENCH_MUTEX:
+            pthread_mutex_lock(&bench.lock);
+            q_en(&bench.q, n);
+            pthread_mutex_unlock(&bench.lock);
+            return true;
+
+        case BENCH_MPMC:
+            return lfq_en(bench.mpmc, n);
+
+        case BENCH_SPSC:
+            return spsc_en(bench.spsc, n);
+    }
+
+    return false;
+}
+
+static struct node_s *bench_de(void)
+{
+    struct node_s *n = 0;
+
+    switch(bench.kind) {
+        case BENCH_MUTEX:
+            pthread_mutex_lock(&bench.lock);
+            n = q_de(&bench.q);
+            pthread_mutex_unlock(&bench.lock);
+            break;
+
+        case BENCH_MPMC:
+            n = lfq_de(bench.mpmc);
+            break;
+
+        case BENCH_SPSC:
+            n = spsc_de(bench.spsc);
+            break;
+    }
+
+    return n;
+}
+
+static void *bench_producer(void *arg)
+{
+    size_t i, ops = BENCH_OPS / bench.threads;
+
+    for(i = 0; i < ops; i++)
+        while(!bench_en(bench.item))
+            sched_yield();
+
+    return 0;
+}
+
+static void *bench_consumer(void *arg)
+{
+    size_t ops = BENCH_OPS / bench.threads * bench.threads;
+
+    while(atomic_load_explicit(&bench.taken, memory_order_relaxed) < ops) {
+        if(bench_de())
+            atomic_fetch_add_explicit(&bench.taken, 1, memory_order_relaxed);
+        else
+            sched_yield();
+    }
+
+    return 0;
+}
+
+static void bench_run(enum bench_kind_e kind, unsigned threads)
+{
+    pthread_t producers[threads], consumers[threads];
+    struct bench_s b = { .threads = threads };
+    unsigned i;
+
+    bench.kind = kind;
+    bench.threads = threads;
+    atomic_store(&bench.taken, 0);
+
+    bench_start(&b, bench_names[kind], BENCH_OPS / threads * threads);
+
+    for(i = 0; i < threads; i++) {
+        pthread_create(&consumers[i], 0, bench_consumer, 0);
+        pthread_create(&producers[i], 0, bench_producer, 0);
+    }
+
+    for(i = 0; i < threads; i++) {
+        pthread_join(producers[i], 0);
+        pthread_join(consumers[i], 0);
+    }
+
+    bench_stop(&b);
+}
+
+int main(int argc, char const *argv[])
+{
+    unsigned threads = argc > 1 ? (unsigned) atoi(argv[1]) :
+        (unsigned) sysconf(_SC_NPROCESSORS_ONLN), i;
+
+    bench.item = int_node_new(0);
+    bench.mpmc = lfq_new(BENCH_QUEUE_SIZE);
+    bench.spsc = spsc_new(BENCH_QUEUE_SIZE);
+    pthread_mutex_init(&bench.lock, 0);
+
+    if(!bench.item || !bench.mpmc || !bench.spsc)
+        return 1;
+
+    bench_run(BENCH_SPSC, 1);
+
+    for(i = 1; i <= MAX(threads, 1); i++) {
+        bench_run(BENCH_MUTEX, i);
+        bench_run(BENCH_MPMC, i);
+    }
+
+    lfq_free(bench.mpmc);
+    spsc_free(bench.spsc);
+    node_free_all(bench.item);
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+#ifndef BST_H_
+#define BST_H_
+
+/*
+ * bst.h
+ *
+ * A self-balancing (AVL) binary search tree built out of ordinary nodes,
+ * along with order statistics for any binary search tree.
+ *
+ * Children are kept in the NODE_LEFT and NODE_RIGHT slots of each node's
+ * table, exactly as with node_bst_insert, so the node_bt_for_each family
+ * works on the result. Each node's height is kept in node_s.height and
+ * the size of its subtree in node_s.count.
+ *
+ * The order statistics (select, rank and range) work on trees built with
+ * either node_bst_insert or node_avl_insert and take O(log n) time on
+ * balanced trees, plus O(k) for the k nodes a range visits.
+ *
+ * Rotations can change which node sits at the top of the tree, so the
+ * functions which modify a tree take the address of the root pointer,
+ * the same way the stack functions do. If the root has an owner (ie. the
+ * tree is stored in another node's table) the owner's slot is kept up
+ * to date as well.
+ *
+ * node_bst_build makes a perfectly balanced tree (which is also a valid
+ * AVL tree) out of an array of nodes in one go, sorting them first if
+ * necessary. Large trees are built by several threads at once.
+ *
+ * node_bst_insert, node_avl_insert, node_avl_find and node_bst_rank
+ * also come in _int and _str versions, which only accept integer or
+ * string nodes and compare them without going through node_diff.
+ *
+ * None of these functions recurse, apart from node_bst_build whose
+ * recursion never goes deeper than the height of the tree it builds.
+ *
+ * For further comments see bst.c
+ */
+
+#define node_height(n) ((n) ? (n)->height : 0)
+#define node_count(n) ((n) ? (n)->count : 0)
+
+struct node_s *node_avl_insert(struct node_s **, struct node_s *);
+struct node_s *node_avl_find(struct node_s *, const struct node_s *);
+struct node_s *node_avl_delete(struct node_s **, const struct node_s *);
+struct node_s *node_avl_remove(struct node_s **, struct node_s *);
+
+/*
+ * The same, for integer and string nodes only, comparing them inline.
+ */
+int node_bst_insert_int(struct node_s *, struct node_s *);
+struct node_s *node_avl_insert_int(struct node_s **, struct node_s *);
+struct node_s *node_avl_find_int(struct node_s *, const struct node_s *);
+size_t node_bst_rank_int(struct node_s *, const struct node_s *);
+
+int node_bst_insert_str(struct node_s *, struct node_s *);
+struct node_s *node_avl_insert_str(struct node_s **, struct node_s *);
+struct node_s *node_avl_find_str(struct node_s *, const struct node_s *);
+size_t node_bst_rank_str(struct node_s *, const struct node_s *);
+
+struct node_s *node_bst_build(struct node_s **, size_t);
+struct node_s *node_bst_select(struct node_s *, size_t);
+size_t node_bst_rank(struct node_s *, const struct node_s *);
+size_t node_bst_range(struct node_s *, const struct node_s *,
+    const struct node_s *, void (*)(struct node_s *));
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef BTREE_H_
+#define BTREE_H_
+
+/*
+ * btree.h
+ *
+ * An ordered set of values kept in a B-tree. Rather than one node per
+ * value, the values are stored side by side in pages of a few hundred
+ * bytes, so a lookup only touches a handful of pages however large the
+ * set grows.
+ *
+ * A B-tree is a node of type node_type_btree, created for a particular
+ * type of value, ie.
+ *
+ * struct node_s *set = btree_node_new(node_type_int);
+ *
+ * The value type must have 'init' (see node.h) and its data must still be
+ * valid after being moved with memcpy, as is the case for integers and
+ * strings. Values are passed in and looked up by node, the same way keys
+ * are for node_avl_find, and copied into the tree; the node you pass is
+ * still yours.
+ *
+ * The iteration functions hand each value to a callback as a temporary
+ * node, which is only valid until the callback returns.
+ *
+ * For further comments see btree.c
+ */
+#define btree_get(d) ((struct btree_s *) (d))
+#define btree_len(t) ((t) ? btree_get((t)->data)->len : 0)
+
+#define btree_node_new(type) node_new(node_type_btree, type, true)
+
+struct btree_page_s;
+
+struct btree_s {
+    const struct node_type_s *type;
+    const struct node_allocator_s *alloc;
+    struct btree_page_s *root;
+    size_t len;
+    unsigned degree, height;
+};
+
+extern const struct node_type_s *node_type_btree;
+
+bool node_btree_insert(struct node_s *tree, const struct node_s *value);
+const void *node_btree_find(const struct node_s *tree,
+    const struct node_s *value);
+bool node_btree_delete(struct node_s *tree, const struct node_s *value);
+size_t node_btree_range(const struct node_s *tree, const struct node_s *lo,
+    const struct node_s *hi, void (*iter)(struct node_s *));
+size_t node_btree_for_each(const struct node_s *tree,
+    void (*iter)(struct node_s *));
+
+#endif
@@ -5,19 +5,39 @@
 #include <stdlib.h>
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <math.h>
 #include <time.h>
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "fail.h"
 #include "random.h"
+#include "pool.h"
 
 #include "node.h"
+#include "bst.h"
 #include "str.h"
 #include "int.h"
 #include "stack.h"
+#include "map.h"
+#include "btree.h"
+#include "lfq.h"
+#include "edge.h"
+#include "graph.h"
+#include "serial.h"
+#include "import.h"
 #include "test.h"
 
 #define pfunc() printf("%s\n", __func__)
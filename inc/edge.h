@@ -0,0 +1,32 @@
+#ifndef EDGE_H_
+#define EDGE_H_
+
+/*
+ * edge.h
+ *
+ * A weighted edge: a node whose data points at another node, along with
+ * the cost of going there. Like a nested node made with
+ * node_new_node_const, an edge never frees the node it points at.
+ *
+ * Edges in a vertex's table count as edges of the graph the vertex
+ * belongs to (see graph.h), with their weight. Nested nodes count too,
+ * with a weight of 1.
+ */
+#define edge_get(d) ((struct edge_s *) (d))
+#define edge_node_to(n) edge_get((n)->data)->to
+#define edge_node_weight(n) edge_get((n)->data)->weight
+
+#define edge_init(to, weight) \
+    &(const struct edge_s) {(struct node_s *) (to), (weight)}
+
+#define edge_node_new(to, weight) \
+    node_new(node_type_edge, edge_init(to, weight), true)
+
+struct edge_s {
+    struct node_s *to;
+    double weight;
+};
+
+extern const struct node_type_s *node_type_edge;
+
+#endif
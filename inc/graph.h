@@ -0,0 +1,81 @@
+#ifndef GRAPH_H_
+#define GRAPH_H_
+
+/*
+ * graph.h
+ *
+ * Graphs of nodes, and read-only snapshots of them for fast traversal.
+ *
+ * A graph is a node whose children are its vertices. A vertex's edges
+ * are the nested nodes (see node_new_node_const) and weighted edges (see
+ * edge.h) in its own table which point at other vertices of the same
+ * graph, so a vertex can belong to only one graph but have any number of
+ * edges to any vertex, including itself. node_graph_connect adds a nested
+ * node, which weighs 1. Anything else in a vertex's table is left alone.
+ *
+ * node_graph_freeze copies a graph's structure into a struct graph_s, a
+ * compressed sparse row snapshot: vertex i's neighbors are
+ * targets[offsets[i]] up to targets[offsets[i + 1]], as indices into the
+ * verts array, which holds the vertex nodes in the order the graph does,
+ * with the edges' weights alongside in weights. Traversing the snapshot
+ * only touches these arrays, instead of chasing pointers from node to
+ * node.
+ *
+ * A snapshot's memory, and the scratch space the searches over it need,
+ * comes from the allocator of the graph node it was made from (see
+ * node_new_with), which it remembers in alloc.
+ *
+ * The snapshot doesn't change with the graph. Freeze it again after
+ * adding or removing vertices or edges, and don't free any vertex nodes
+ * while the snapshot's verts array is still in use.
+ *
+ * The traversals fill in an array with an entry per vertex, with
+ * GRAPH_NONE for vertices they didn't reach, and return how many they
+ * did reach.
+ *
+ * graph_dijkstra finds the shortest weighted paths from one vertex to all
+ * the others, and graph_astar the shortest path between two, guided by an
+ * optional heuristic: an estimate of the distance from a vertex to the
+ * target which must never be more than the real distance. Without one
+ * it's Dijkstra's algorithm, stopping once the target is reached. Both
+ * expect weights to be non-negative. node_graph_path does the same as
+ * graph_astar with vertex nodes in place of indices. Freezing costs a
+ * pass over the whole graph, so freeze it once and search the snapshot
+ * as many times as needed.
+ *
+ * For further comments see graph.c
+ */
+
+#define GRAPH_NONE ((size_t) -1)
+
+#define graph_degree(g, v) ((g)->offsets[(v) + 1] - (g)->offsets[v])
+#define graph_neighbors(g, v) ((g)->targets + (g)->offsets[v])
+
+struct graph_s {
+    size_t nverts, nedges;
+    size_t *offsets, *targets;
+    double *weights;
+    struct node_s **verts;
+    const struct node_allocator_s *alloc;
+};
+
+struct node_s *node_graph_connect(struct node_s *from,
+    const struct node_s *to);
+struct graph_s *node_graph_freeze(const struct node_s *g);
+void graph_free(struct graph_s *g);
+size_t graph_bfs(const struct graph_s *g, size_t source, size_t *dist);
+size_t graph_bfs_parallel(const struct graph_s *g, size_t source,
+    size_t *dist, unsigned threads);
+size_t graph_dfs(const struct graph_s *g, size_t source, size_t *order);
+size_t graph_components(const struct graph_s *g, size_t *comp);
+size_t graph_dijkstra(const struct graph_s *g, size_t source, double *dist,
+    size_t *prev);
+size_t graph_astar(const struct graph_s *g, size_t source, size_t target,
+    double (*h)(const struct node_s *, const struct node_s *, void *),
+    void *ctx, size_t *path, double *cost);
+size_t node_graph_path(const struct graph_s *g, const struct node_s *from,
+    const struct node_s *to,
+    double (*h)(const struct node_s *, const struct node_s *, void *),
+    void *ctx, struct node_s **path, double *cost);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef IMPORT_H_
+#define IMPORT_H_
+
+/*
+ * import.h
+ *
+ * Building graphs and maps straight from text files.
+ *
+ * node_import_graph reads an edge list, one edge per line: the label of
+ * the vertex it leaves, the label of the vertex it leads to and, if the
+ * edges are weighted, its weight. Each distinct label becomes one string
+ * vertex of the graph (see graph.h), in the order the labels first
+ * appear, and each line an edge between them.
+ *
+ * node_import_map reads a key and a value from each line into a map of
+ * string keys, each with its string value as its first child (see
+ * map.h). Later lines replace earlier ones with the same key.
+ *
+ * Both read the file in large chunks and parse it in place, so the only
+ * allocations are for the nodes themselves. Empty lines and lines
+ * starting with '#' are skipped, as are lines with too few fields.
+ *
+ * A struct node_import_s, which may be 0 for the defaults, describes the
+ * file and how much to expect of it:
+ *
+ *  sep - the character between fields, or 0 for any run of spaces and
+ *   tabs. With a separator, the last field runs to the end of the line.
+ *  weighted - edge lines have a third field, the weight, which makes the
+ *   edges weighted edges (see edge.h) rather than nested nodes.
+ *  undirected - add an edge in both directions for each line.
+ *  intern - intern the labels and keys (see str_node_new_interned). Only
+ *   those of at least STR_SSO_SIZE bytes are interned; shorter ones are
+ *   kept inline in their nodes either way.
+ *  presize - read the file twice, the first time to find every vertex and
+ *   count its edges, so that every table is allocated once at its final
+ *   size.
+ *  vertices, edges - expected numbers of vertices (or keys) and of edge
+ *   lines, if known, to size tables up front without a second pass.
+ *
+ * For further comments see import.c
+ */
+
+struct node_import_s {
+    char sep;
+    bool weighted, undirected, intern, presize;
+    size_t vertices, edges;
+};
+
+struct node_s *node_import_graph(const char *path,
+    const struct node_import_s *o);
+struct node_s *node_import_map(const char *path,
+    const struct node_import_s *o);
+
+#endif
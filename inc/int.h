@@ -15,4 +15,13 @@ struct int_s { int n; };
 
 extern const struct node_type_s *node_type_int;
 
+/*
+ * Compare the data of two integer nodes. This is the integer type's
+ * 'diff', made available for inlining.
+ */
+static inline int int_data_diff(const void *a, const void *b)
+{
+    return (int_get_n(a) > int_get_n(b)) - (int_get_n(a) < int_get_n(b));
+}
+
 #endif
@@ -0,0 +1,59 @@
+#ifndef LFQ_H_
+#define LFQ_H_
+
+/*
+ * lfq.h
+ *
+ * Bounded lock-free queues of node pointers, for handing nodes between
+ * threads without a lock.
+ *
+ * struct lfq_s may be shared by any number of producers and consumers.
+ * struct spsc_s is a faster variant for exactly one producer thread and
+ * one consumer thread.
+ *
+ * Both behave like q_en/q_de: items come out in the order they went in,
+ * and the queue never touches the nodes themselves. Unlike q_en, the
+ * queues have a fixed capacity (rounded up to a power of two), so
+ * enqueuing onto a full queue fails instead.
+ *
+ * These aren't nodes themselves since nothing in node.c is safe to use
+ * from several threads at once.
+ *
+ * For further comments see lfq.c
+ */
+#include <stdatomic.h>
+
+#define LFQ_CACHE_LINE 64
+
+struct lfq_cell_s {
+    atomic_size_t seq;
+    struct node_s *n;
+};
+
+struct lfq_s {
+    struct lfq_cell_s *cells;
+    size_t mask;
+    _Alignas(LFQ_CACHE_LINE) atomic_size_t tail;
+    _Alignas(LFQ_CACHE_LINE) atomic_size_t head;
+};
+
+struct spsc_s {
+    struct node_s **buf;
+    size_t mask;
+    _Alignas(LFQ_CACHE_LINE) atomic_size_t tail;
+    size_t head_cache;
+    _Alignas(LFQ_CACHE_LINE) atomic_size_t head;
+    size_t tail_cache;
+};
+
+struct lfq_s *lfq_new(size_t);
+void lfq_free(struct lfq_s *);
+bool lfq_en(struct lfq_s *, struct node_s *);
+struct node_s *lfq_de(struct lfq_s *);
+
+struct spsc_s *spsc_new(size_t);
+void spsc_free(struct spsc_s *);
+bool spsc_en(struct spsc_s *, struct node_s *);
+struct node_s *spsc_de(struct spsc_s *);
+
+#endif
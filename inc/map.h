@@ -0,0 +1,49 @@
+#ifndef MAP_H_
+#define MAP_H_
+
+/*
+ * map.h
+ *
+ * A hash map of child nodes. A map is a node of type node_type_map whose
+ * children are kept in its table like any other node's, along with an
+ * open addressing index over them so that a child can be found by key
+ * in constant time.
+ *
+ * A child is its own key: two children are the same key when they have
+ * the same type and node_diff finds them equal. To associate a value
+ * with a key, put the value in the key's table, ie.
+ *
+ * node_put(key, NODE_NEXT, value);
+ * node_map_put(map, key);
+ *
+ * Keys must be of a type with a 'hash' function, and can't be shared
+ * (see node_share), though values can. Always add and remove
+ * children with the functions below, never with node_put or
+ * node_release directly, or the index will go stale.
+ *
+ * For further comments see map.c
+ */
+#define map_get(d) ((struct map_s *) (d))
+#define map_len(m) ((m) ? map_get((m)->data)->len : 0)
+
+#define map_node_new() node_new(node_type_map, &(const struct map_s) {0}, true)
+
+struct map_slot_s {
+    size_t hash;
+    struct node_s *n;
+};
+
+struct map_s {
+    struct map_slot_s *slots;
+    size_t len, max;
+};
+
+extern const struct node_type_s *node_type_map;
+
+struct node_s *node_map_get(const struct node_s *map,
+    const struct node_s *key);
+struct node_s *node_map_put(struct node_s *map, struct node_s *n);
+struct node_s *node_map_remove(struct node_s *map, const struct node_s *key);
+bool node_map_reserve(struct node_s *map, size_t n);
+
+#endif
@@ -23,6 +23,18 @@ enum node_order_e {
 #define NODE_LEFT   0
 #define NODE_RIGHT  1
 
+/*
+ * Types whose data fits in this many bytes have it stored inside
+ * the node itself rather than in a separate allocation.
+ */
+#define NODE_INLINE_SIZE 32
+
+/*
+ * The fields of struct node_s up to and including the inline data fit in
+ * this many bytes, a cache line on most machines. See node.c.
+ */
+#define NODE_HOT_SIZE 64
+
 /*
  * macros
  */
@@ -46,30 +58,131 @@ enum node_order_e {
 /*
  * Check what's at index i in n's table.
  */
-#define node_at(n, i) ((n && (n->len > i)) ? n->table[i] : 0)
+#define node_at(n, i) (((n) && ((n)->len > (i))) ? (n)->table[i] : 0)
 
 #define node_free_one(n) node_free(n, false)
 #define node_free_all(n) node_free(n, true)
 
+/*
+ * Drop a reference to a shared node, freeing it along with its children
+ * once nothing holds it any more. Unshared nodes are simply freed.
+ */
+#define node_unref(n) node_free_all(n)
+
+#define node_shared(n) ((n)->refs != 0)
+
 #define node_new_node(n) node_new(node_type_node, (struct node_s *) n, true)
 
 #define node_new_node_const(n) node_new(node_type_node, (struct node_s *) n, false)
 
 #define node_data(n) ((struct node_s *) (n)->data)
 
+/*
+ * The table growth policy in effect for a node.
+ */
+#define node_policy(n) ((n)->policy ? (n)->policy : \
+    (n)->type->policy ? (n)->type->policy : &node_policy_default)
+
+/*
+ * Check whether nodes of a given type keep their data inline.
+ */
+#define node_type_inline(t) ((t)->init && (t)->size <= NODE_INLINE_SIZE)
+
 #define node_pre_order(n, it) node_bt_for_each(n, it, NODE_PRE_ORDER)
 #define node_in_order(n, it) node_bt_for_each(n, it, NODE_IN_ORDER)
 #define node_post_order(n, it) node_bt_for_each(n, it, NODE_POST_ORDER)
 
+/*
+ * Loop over a binary tree without a callback, ie.
+ * node_bt_loop(c, root, NODE_IN_ORDER) { ... }
+ * Use a struct node_iter_s instead if you change the tree as you go.
+ */
+#define node_bt_loop(c, root, o) \
+    for(c = node_bt_first(root, o); c; c = node_bt_next(root, c, o))
+
 /*
  * data structures
  */
 
+/*
+ * A table growth policy. Tables grow to 'grow' times the index being
+ * written to and never below 'min' slots. Once fewer than 1/'shrink' of
+ * the slots are in use they shrink by a factor of 'grow' (down to 'min',
+ * or away entirely if 'min' is 0). A 'shrink' of 0 means never shrink.
+ *
+ * Keep 'shrink' larger than 'grow', otherwise a table hovering around
+ * a boundary will be resized back and forth.
+ *
+ * Nodes use their own policy if they have one, then their type's,
+ * and node_policy_default otherwise.
+ */
+struct node_policy_s {
+    size_t min;
+    unsigned grow, shrink;
+};
+
+extern const struct node_policy_s node_policy_default, node_policy_keep;
+
+/*
+ * An allocator for nodes, their tables and their data. Blocks are always
+ * resized and freed along with the size they were allocated with, so an
+ * allocator doesn't have to keep track of sizes itself. Like realloc(3),
+ * 'realloc' may be given a null block (with an old size of 0). ctx is
+ * passed to each of the functions as is.
+ *
+ * Allocators which can safely be used by several threads at once (and
+ * free memory allocated on another thread) set thread_safe.
+ *
+ * node_allocator_heap uses malloc and is the default. node_allocator_pool
+ * uses the calling thread's pool (see pool.h).
+ *
+ * A node's allocator also provides for whatever hangs off it: its table,
+ * its data, a map's index, a stack's ring and a frozen graph's snapshot
+ * along with the searches' scratch space (see graph.h). Interned string
+ * buffers are shared between nodes and always come from the heap. The
+ * lock-free queues, and the temporary buffers of node_save, node_load
+ * and the importer, use malloc directly and aren't counted by node_stats.
+ */
+struct node_allocator_s {
+    void *(*alloc)(void *ctx, size_t size);
+    void *(*realloc)(void *ctx, void *p, size_t old, size_t size);
+    void (*free)(void *ctx, void *p, size_t size);
+    void *ctx;
+    bool thread_safe;
+};
+
+extern const struct node_allocator_s node_allocator_heap, node_allocator_pool;
+
 /*
  * To create a new node type, make a variable with the fields filled in,
  * then create an extern const pointer to it. You can then use that pointer
  * as the *type* required by node_new.
  *
+ * A type can manage its data in one of two ways. If it provides 'init',
+ * node_new sets aside 'size' bytes of storage for the data (inside the
+ * node itself when 'size' is at most NODE_INLINE_SIZE, otherwise from the
+ * node's allocator) and 'init' fills them in. 'fini', if present,
+ * releases whatever 'init' acquired, but not the storage itself. Both are
+ * given the node's allocator, which they should use (with node_mem_alloc
+ * and friends) for any memory of their own. Otherwise, 'new' must
+ * allocate and return the data and 'freev' must free it.
+ *
+ * 'hash', if present, returns a hash of the data which is the same for
+ * any two values 'diff' finds equal. Only types with a hash can be used
+ * as keys in a map (see map.h).
+ *
+ * 'to_str' builds a string node representing the data. It is only called
+ * the first time someone asks for the node's string. 'print', if present,
+ * writes the same representation into a caller-supplied buffer the way
+ * snprintf does, so that node_render can avoid allocating.
+ *
+ * 'serialize' and 'deserialize', if present, let nodes of the type be
+ * saved to a file (see serial.h). 'serialize' writes the data as a
+ * self-contained string of bytes into a caller-supplied buffer and,
+ * like 'print', returns the number of bytes it needs, which must not be
+ * 0. 'deserialize' does the job of 'init' from those bytes. Only types
+ * with 'init' can be deserialized.
+ *
  * See str.c and str.h for an example of how this is done. Also, we declared
  * our own node type further down to be used to store nodes within nodes.
  */
@@ -77,20 +190,78 @@ extern const struct node_type_s {
     size_t size;
     void (*freev)(void *),
         *(*new)(const void *);
+    bool (*init)(void *, const void *, const struct node_allocator_s *);
+    void (*fini)(void *, const struct node_allocator_s *);
     int (*diff)(const void *, const void *);
+    size_t (*hash)(const void *);
     struct node_s *(*to_str)(const void *);
+    int (*print)(const void *, char *, size_t);
+    size_t (*serialize)(const void *, void *, size_t);
+    bool (*deserialize)(void *, const void *, size_t,
+        const struct node_allocator_s *);
+    const struct node_policy_s *policy;
     const char *name;
 } *node_type_node;
 
 /*
  * The basic node data structure.
+ *
+ * In binary search trees built with node_bst_insert or the functions
+ * in bst.h, count is the number of nodes in the node's subtree and
+ * height is the height of that subtree.
+ *
+ * A node normally belongs to at most one owner, whose table it is in at
+ * index id, and putting it in another table takes it away from the first.
+ * Once shared (see node_share) it has no owner and refs counts the
+ * references to it instead: one for each table slot holding it, one for
+ * each nested node which frees it, and any taken with node_ref. Freeing
+ * a shared node drops a reference, and it's only freed with the last one.
+ * Like everything else about nodes, the count isn't safe to change from
+ * several threads at once.
  */
 struct node_s {
+    /*
+     * What lookups and traversals read, kept within the first cache line
+     * (see NODE_HOT_SIZE).
+     */
     void *data;
-    bool frees_data;
     const struct node_type_s *type;
-    struct node_s *str, *owner, **table;
-    size_t id, len, max, count;
+    struct node_s **table;
+    size_t len;
+    union {
+        void *p;
+        long long ll;
+        double d;
+        unsigned char bytes[NODE_INLINE_SIZE];
+    } inline_data;
+
+    /*
+     * Everything else.
+     */
+    size_t max, count, height;
+    struct node_s *str, *owner;
+    size_t id;
+    const struct node_allocator_s *alloc;
+    const struct node_policy_s *policy;
+    unsigned refs;
+    bool frees_data;
+};
+
+/*
+ * Node memory counters, see node_stats. bytes is the number of bytes
+ * currently in use and peak the most there have been in use at once.
+ */
+struct node_stats_s {
+    size_t allocs, frees;
+    long long bytes, peak;
+};
+
+/*
+ * A cursor over a binary tree. See node_iter_next.
+ */
+struct node_iter_s {
+    struct node_s *root, *next;
+    enum node_order_e order;
 };
 
 /*
@@ -110,14 +281,42 @@ struct nested_node_s {
 
 void node_free(struct node_s *, bool);
 struct node_s *node_new(const struct node_type_s *, const void *, bool);
+struct node_s *node_new_with(const struct node_allocator_s *,
+    const struct node_type_s *, const void *, bool);
+struct node_s *node_new_serialized(const struct node_allocator_s *,
+    const struct node_type_s *, const void *, size_t);
 int node_diff(const struct node_s *a, const struct node_s *b);
+size_t node_hash(const struct node_s *n);
 struct node_s *node_to_str(struct node_s *n);
 char *node_string(struct node_s *n);
+int node_render(const struct node_s *n, char *buf, size_t size);
 size_t node_put(struct node_s *, size_t, struct node_s *);
+void node_set(struct node_s *, size_t, struct node_s *);
+size_t node_reserve(struct node_s *, size_t);
+size_t node_shrink_to_fit(struct node_s *);
 int node_bst_insert(struct node_s *a, struct node_s *b);
 void node_bt_for_each(struct node_s *n, void(*iter)(struct node_s *),
     enum node_order_e o);
+struct node_s *node_bt_first(struct node_s *root, enum node_order_e o);
+struct node_s *node_bt_next(struct node_s *root, struct node_s *n,
+    enum node_order_e o);
+void node_iter_init(struct node_iter_s *it, struct node_s *root,
+    enum node_order_e o);
+struct node_s *node_iter_next(struct node_iter_s *it);
 struct node_s *node_release(struct node_s *, size_t);
+struct node_s *node_share(struct node_s *);
+struct node_s *node_ref(struct node_s *);
+void *node_mem_alloc(const struct node_allocator_s *, size_t);
+void *node_mem_realloc(const struct node_allocator_s *, void *, size_t, size_t);
+void node_mem_free(const struct node_allocator_s *, void *, size_t);
+void node_allocator_set(const struct node_allocator_s *);
+void node_allocator_use(const struct node_allocator_s *);
+const struct node_allocator_s *node_allocator(void);
+void node_pool_enable(bool);
+bool node_pool_enabled(void);
+void node_pool_reset(void);
+const struct node_stats_s *node_stats(void);
+void node_stats_reset(void);
 
 /*
  * static inline void node_pr(const struct node_s *n)
@@ -0,0 +1,30 @@
+#ifndef POOL_H_
+#define POOL_H_
+
+/*
+ * pool.h
+ *
+ * A per-thread slab allocator for small, fixed-size objects.
+ *
+ * Requests are rounded up to one of POOL_CLASSES size classes, each with
+ * its own free list. Free lists are refilled by carving blocks out of
+ * large slabs. Anything bigger than POOL_MAX is handed to malloc but is
+ * still tracked by the pool so that pool_reset can release it.
+ *
+ * All state is thread-local. Memory must be freed (or reset) on the same
+ * thread that allocated it.
+ *
+ * For further comments see pool.c
+ */
+
+#define POOL_ALIGN      16
+#define POOL_CLASSES    16
+#define POOL_MAX        (POOL_ALIGN * POOL_CLASSES)
+#define POOL_SLAB_SIZE  (64 * 1024)
+
+void *pool_alloc(size_t size);
+void *pool_realloc(void *p, size_t old, size_t size);
+void pool_free(void *p, size_t size);
+void pool_reset(void);
+
+#endif
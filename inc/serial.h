@@ -0,0 +1,96 @@
+#ifndef SERIAL_H_
+#define SERIAL_H_
+
+/*
+ * serial.h
+ *
+ * Saving nodes to a file, and loading them back either as nodes or as a
+ * read-only view of the file itself.
+ *
+ * node_save writes a node along with everything it holds: the children
+ * in its table, their children and so on, and the nodes its nested nodes
+ * and edges point at. Every node must be a nested node, an edge, or of a
+ * type with 'serialize' and 'deserialize' (see node.h) which has been
+ * registered with node_type_register, as the types in this library are.
+ * Types are stored by name, and nodes refer to each other by their index
+ * in the file, the node passed to node_save being index 0. A shared node
+ * (see node_share) is saved once, however many nodes hold it, and
+ * comes back shared and held by the same ones.
+ *
+ * node_load makes the nodes again. node_view_open maps the file into
+ * memory instead and reads it in place, without allocating anything per
+ * node: a node's payload is whatever its type's 'serialize' wrote (a
+ * string's is its characters, with a terminator) and its children are a
+ * list of indices. Nested nodes and edges have a ref, the index of the
+ * node they point at.
+ *
+ * The format is versioned (NODE_FILE_VERSION) and uses the byte order
+ * of the machine that wrote it. Files written with another version or
+ * byte order are rejected.
+ *
+ * For further comments see serial.c
+ */
+
+#define NODE_FILE_MAGIC 0x45444f4eu
+#define NODE_FILE_VERSION 1
+#define NODE_FILE_NAME_SIZE 32
+#define NODE_FILE_NONE ((uint64_t) -1)
+
+/*
+ * node_record_s flags
+ */
+#define NODE_RECORD_FREES_DATA 1
+#define NODE_RECORD_SHARED 2
+
+#define node_view_len(v) ((size_t) (v)->file->nnodes)
+#define node_view_at(v, i) ((v)->records + (i))
+#define node_view_type(v, i) ((v)->types[node_view_at(v, i)->type])
+#define node_view_data(v, i) ((v)->payload + node_view_at(v, i)->payload)
+#define node_view_size(v, i) ((size_t) node_view_at(v, i)->size)
+#define node_view_ref(v, i) node_view_at(v, i)->ref
+#define node_view_children(v, i) ((size_t) node_view_at(v, i)->len)
+#define node_view_child(v, i, j) \
+    (v)->children[node_view_at(v, i)->children + (j)]
+
+/*
+ * The file starts with a header, followed by ntypes type names of
+ * NODE_FILE_NAME_SIZE bytes each, nnodes records, nchildren child
+ * indices and the payloads, each section starting at the offset given
+ * in the header. Everything is aligned to 8 bytes.
+ */
+struct node_file_s {
+    uint32_t magic, version;
+    uint64_t ntypes, nnodes, nchildren;
+    uint64_t types, records, children, payload, size;
+};
+
+/*
+ * A saved node. payload is relative to the payload section, children is
+ * the position of its first child in the child indices and len the
+ * number of children (including empty slots, which are NODE_FILE_NONE).
+ */
+struct node_record_s {
+    uint32_t type, flags;
+    uint64_t ref, payload, size, children, len, count, height;
+};
+
+/*
+ * A file opened with node_view_open. types holds the node type for each
+ * type name in the file, which is 0 for names which aren't registered.
+ */
+struct node_view_s {
+    const struct node_file_s *file;
+    const struct node_record_s *records;
+    const uint64_t *children;
+    const unsigned char *payload;
+    const struct node_type_s **types;
+};
+
+bool node_type_register(const struct node_type_s *type);
+const struct node_type_s *node_type_find(const char *name);
+bool node_save(const struct node_s *n, const char *path);
+struct node_s *node_load(const char *path);
+struct node_view_s *node_view_open(const char *path);
+void node_view_close(struct node_view_s *v);
+
+#endif
@@ -11,9 +11,12 @@
  * Hence stack_enq and stack_push are synonymous while stack_pop and
  * stack_deq are implemented as separate functions.
  *
- * We may further consider developing an "unshift" operation which
- * would place an item back onto the bottom of the stack. This would
- * provide us with "four-way" add/remove functionality.
+ * The "unshift" operation places an item back onto the bottom of the
+ * stack. This provides us with "four-way" add/remove functionality.
+ *
+ * A stack is a single node of type node_type_stack which keeps the
+ * items in a growable ring buffer, so none of these operations allocate
+ * anything per item.
  *
  * For further comments see stack.c
  */
@@ -22,7 +25,18 @@
 #define q_en stack_enq
 #define q_de stack_deq
 
+#define stack_get(d) ((struct stack_s *) (d))
+#define stack_len(s) ((s) ? stack_get((s)->data)->len : 0)
+
+struct stack_s {
+    const struct node_s **buf;
+    size_t head, len, max;
+};
+
+extern const struct node_type_s *node_type_stack;
+
 void stack_push(struct node_s **, const struct node_s *);
+void stack_unshift(struct node_s **, const struct node_s *);
 struct node_s *stack_pop(struct node_s **);
 struct node_s *stack_deq(struct node_s **);
 
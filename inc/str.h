@@ -1,10 +1,24 @@
 #ifndef STR_H_
 #define STR_H_
 
+/*
+ * Strings shorter than STR_SSO_SIZE are stored inside struct str_s
+ * itself (and so inside the node, see NODE_INLINE_SIZE). Longer ones
+ * get a buffer of their own.
+ */
+#define STR_SSO_SIZE 16
+
+/*
+ * str_s flags
+ */
+#define STR_INLINE 1
+#define STR_INTERNED 2
+
 #define str_get(d) ((struct str_s *) (d))
 #define str_at(d, member) str_get(d)->member
 #define str_len(d) str_at(d, len)
-#define str_buf(d) str_at(d, buf)
+#define str_buf(d) \
+    (str_at(d, flags) & STR_INLINE ? str_at(d, sso) : str_at(d, buf))
 
 #define str_node_get(n) str_get(n->data)
 #define str_node_at(n) str_at(n->data)
@@ -12,17 +26,75 @@
 #define str_node_buf(n) (n ? str_buf(n->data) : "no node!")
 
 #define str_init(s, l) &(const struct str_s) {.buf = (char *) s, .len = l}
+#define str_init_interned(s, l) \
+    &(const struct str_s) {.buf = (char *) s, .len = l, .flags = STR_INTERNED}
 
 #define str_node_new(s) node_new(node_type_str, str_init(s, strlen(s)), true)
 
 #define str_node_new_const(s) \
     node_new(node_type_str, str_init(s, strlen(s)), false)
 
+/*
+ * Create a string node from the first l bytes of s. s doesn't have to be
+ * NUL-terminated and may contain NUL bytes.
+ */
+#define str_node_new_len(s, l) node_new(node_type_str, str_init(s, l), true)
+
+/*
+ * Create a string node whose buffer is shared with every other interned
+ * string node holding the same string. See str_intern_enable. Strings
+ * shorter than STR_SSO_SIZE are stored inline instead, as always, since
+ * they have no buffer to share.
+ */
+#define str_node_new_interned(s) \
+    node_new(node_type_str, str_init_interned(s, strlen(s)), true)
+
+/*
+ * When used as an initializer (see str_init), buf always points to the
+ * source characters and flags is either 0 or STR_INTERNED.
+ */
 struct str_s {
-    char *buf;
     size_t len;
+    union {
+        char *buf;
+        char sso[STR_SSO_SIZE];
+    };
+    unsigned flags;
 };
 
 extern const struct node_type_s *node_type_str;
 
+void str_intern_enable(bool);
+size_t str_intern_count(void);
+int str_cmp_buf(const char *, const char *, size_t);
+size_t str_hash_buf(const char *, size_t);
+
+/*
+ * Compare the data of two string nodes. This is the string type's 'diff',
+ * made available for inlining. Strings are ordered byte by byte, with a
+ * string coming after any of its prefixes.
+ */
+static inline int str_data_diff(const void *a, const void *b)
+{
+    if(a == b)
+        return 0;
+
+    if(!a || !b)
+        return -1;
+
+    size_t la = str_len(a), lb = str_len(b);
+
+    /*
+     * Interned strings are equal exactly when they share a buffer.
+     */
+    if(str_buf(a) == str_buf(b) && la == lb)
+        return 0;
+
+    int diff = str_cmp_buf(str_buf(a), str_buf(b), la < lb ? la : lb);
+    if(diff)
+        return diff;
+
+    return la < lb ? -1 : la > lb;
+}
+
 #endif
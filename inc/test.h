@@ -12,7 +12,11 @@ void bitfield_test();
 #define test_pass_round(res, s) do { \
     res.failed += res.rfail; \
     res.passed += res.rpass; \
-    printf("[ %s ] %s\n", res.rfail ? "errors" : "passed", s); \
+    res.ms += res.rms; \
+    res.allocs += res.rallocs; \
+    res.peak = MAX(res.peak, res.rpeak); \
+    printf("[ %s ] %s (%.2f ms, %lu allocs, %lld bytes peak)\n", \
+        res.rfail ? "errors" : "passed", s, res.rms, res.rallocs, res.rpeak); \
     res.rfail = 0; \
     res.rpass = 0; \
 } while(0)
@@ -30,12 +34,45 @@ void bitfield_test();
 #define test_fail(fcond, fmt, ...) test_do(fcond, return, fmt, ##__VA_ARGS__)
 #define test_break(fcond, fmt, ...) test_do(fcond, break, fmt, ##__VA_ARGS__)
 
-#define test_result_new(name) { 0, 0, 0, 0, 0, name }
+#define test_result_new(s) { .name = s }
 
+/*
+ * The r-prefixed members are for the current round, the others are
+ * totals. ms is wall time, allocs counts node allocations (see
+ * node_stats) and peak is the most node memory a round had in use at
+ * once, beyond what was in use when it started.
+ */
 struct test_result_s {
     unsigned passed, failed, rpass, rfail;
     float rate;
     const char *name;
+    double ms, rms, start;
+    size_t allocs, rallocs;
+    long long peak, rpeak, base;
 };
 
+static inline double test_now_ms(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1e3 + t.tv_nsec / 1e6;
+}
+
+/*
+ * Start and stop measuring a round.
+ */
+static inline void test_start(struct test_result_s *res)
+{
+    node_stats_reset();
+    res->base = node_stats()->bytes;
+    res->start = test_now_ms();
+}
+
+static inline void test_stop(struct test_result_s *res)
+{
+    res->rms = test_now_ms() - res->start;
+    res->rallocs = node_stats()->allocs;
+    res->rpeak = node_stats()->peak - res->base;
+}
+
 #endif
@@ -0,0 +1,562 @@
+/*
+ * bst.c
+ *
+ * A self-balancing (AVL) binary search tree built out of ordinary nodes.
+ *
+ * Every node's left and right subtree heights differ by at most one,
+ * which keeps the height of the tree below 1.44 log2(n). After each
+ * insertion or removal we walk back up through the owner pointers,
+ * updating heights and rotating wherever the balance was broken.
+ *
+ * Nodes are relinked with node_set rather than node_put and
+ * node_release, since a rotation moves several nodes at once and the
+ * tables involved never need to shrink.
+ */
+#include "common.h"
+
+/*
+ * macros
+ */
+#define bst_left(n) node_at(n, NODE_LEFT)
+#define bst_right(n) node_at(n, NODE_RIGHT)
+#define bst_other(dir) ((dir) == NODE_LEFT ? NODE_RIGHT : NODE_LEFT)
+
+/*
+ * node_bst_build hands the left half of any range of at least
+ * BST_PARALLEL_MIN nodes to a new thread, for the top BST_PARALLEL_DEPTH
+ * levels of the tree (so up to 2^BST_PARALLEL_DEPTH threads at once).
+ */
+#define BST_PARALLEL_MIN (1 << 16)
+#define BST_PARALLEL_DEPTH 3
+
+/*
+ * A range of sorted nodes to be made into a subtree, and its root once
+ * it has been. depth is the number of levels of threads still allowed
+ * below it.
+ */
+struct bst_build_s {
+    struct node_s **nodes;
+    size_t count;
+    unsigned depth;
+    struct node_s *root;
+};
+
+/*
+ * static functions
+ */
+
+static void bst_update(struct node_s *n)
+{
+    struct node_s *l = bst_left(n), *r = bst_right(n);
+    size_t hl = node_height(l), hr = node_height(r);
+
+    n->height = MAX(hl, hr) + 1;
+    n->count = node_count(l) + node_count(r) + 1;
+}
+
+/*
+ * static void bst_replace(struct node_s **root, struct node_s *old,
+ *  struct node_s *new)
+ * Put new (which may be 0) in old's place under old's owner. The root
+ * pointer follows along if old was at the top of the tree.
+ */
+static void bst_replace(struct node_s **root, struct node_s *old,
+    struct node_s *new)
+{
+    if(old->owner) {
+        node_set(old->owner, old->id, new);
+    } else if(new) {
+        new->owner = 0;
+        new->id = 0;
+    }
+
+    if(old == *root)
+        *root = new;
+}
+
+/*
+ * static struct node_s *bst_rotate(struct node_s **root, struct node_s *x,
+ *  size_t dir)
+ * Rotate the subtree rooted at x in the given direction. x's child on
+ * the opposite side takes its place, which we return.
+ */
+static struct node_s *bst_rotate(struct node_s **root, struct node_s *x,
+    size_t dir)
+{
+    struct node_s *y = node_at(x, bst_other(dir)), *b = node_at(y, dir);
+
+    bst_replace(root, x, y);
+    node_set(x, bst_other(dir), b);
+    node_set(y, dir, x);
+
+    bst_update(x);
+    bst_update(y);
+
+    return y;
+}
+
+/*
+ * static struct node_s *bst_balance(struct node_s **root, struct node_s *z)
+ * Restore the balance of the subtree rooted at z, assuming both of its
+ * subtrees are balanced. Return the new root of the subtree.
+ */
+static struct node_s *bst_balance(struct node_s **root, struct node_s *z)
+{
+    struct node_s *l = bst_left(z), *r = bst_right(z);
+    size_t hl = node_height(l), hr = node_height(r);
+
+    if(hl > hr + 1) {
+        if(node_height(bst_left(l)) < node_height(bst_right(l)))
+            bst_rotate(root, l, NODE_LEFT);
+
+        return bst_rotate(root, z, NODE_RIGHT);
+    }
+
+    if(hr > hl + 1) {
+        if(node_height(bst_right(r)) < node_height(bst_left(r)))
+            bst_rotate(root, r, NODE_RIGHT);
+
+        return bst_rotate(root, z, NODE_LEFT);
+    }
+
+    bst_update(z);
+    return z;
+}
+
+/*
+ * static void bst_fix(struct node_s **root, struct node_s *z)
+ * Rebalance every subtree from z up to the root of the tree.
+ */
+static void bst_fix(struct node_s **root, struct node_s *z)
+{
+    for(; z; z = z->owner) {
+        z = bst_balance(root, z);
+        if(z == *root)
+            break;
+    }
+}
+
+static int bst_sort_diff(const void *a, const void *b)
+{
+    return node_diff(*(struct node_s * const *) a,
+        *(struct node_s * const *) b);
+}
+
+/*
+ * static void *bst_build(void *arg)
+ * Build a balanced subtree out of a struct bst_build_s range, with the
+ * middle node at its root. Takes and returns a void pointer so that it
+ * can be run as a thread.
+ */
+static void *bst_build(void *arg)
+{
+    struct bst_build_s *b = (struct bst_build_s *) arg;
+
+    if(!b->count) {
+        b->root = 0;
+        return 0;
+    }
+
+    size_t mid = b->count / 2;
+    unsigned depth = b->depth ? b->depth - 1 : 0;
+    struct bst_build_s l = { b->nodes, mid, depth, 0 },
+        r = { b->nodes + mid + 1, b->count - mid - 1, depth, 0 };
+    pthread_t t;
+
+    bool threaded = b->depth && b->count >= BST_PARALLEL_MIN &&
+        !pthread_create(&t, 0, bst_build, &l);
+
+    if(!threaded)
+        bst_build(&l);
+
+    bst_build(&r);
+
+    if(threaded)
+        pthread_join(t, 0);
+
+    b->root = b->nodes[mid];
+    node_set(b->root, NODE_LEFT, l.root);
+    node_set(b->root, NODE_RIGHT, r.root);
+    bst_update(b->root);
+
+    return 0;
+}
+
+/*
+ * non-static functions
+ */
+
+#define bst_typed(t, n) (!(t) || ((n)->type == (t)))
+
+/*
+ * Specialized search routines
+ *
+ * The routines which compare a node with every node on a path through
+ * the tree are generated once for each way of comparing, so that the
+ * integer and string variants compare inline rather than calling through
+ * node_diff and the type's 'diff' pointer.
+ *
+ * bst_define(suffix, ntype, diff) generates node_bst_insert<suffix>,
+ * node_avl_insert<suffix>, node_avl_find<suffix> and node_bst_rank<suffix>
+ * for nodes of type ntype (or any type, if it's 0), using diff(a, b) to
+ * compare two nodes of that type.
+ *
+ * Each of the generated functions is documented here, once for all of
+ * its versions.
+ *
+ * int node_bst_insert(struct node_s *a, struct node_s *b)
+ *  Insert b into the binary search tree rooted at a. Nodes which compare
+ *  greater go to the right, all others go to the left.
+ *
+ * output:
+ *  int - b's subtree size, or 0 if b wasn't inserted.
+ *
+ * notes:
+ *  - The tree isn't rebalanced. See node_avl_insert for a self-balancing
+ *    tree.
+ *  - Each node's count and height are kept up to date as the size and
+ *    height of its subtree, as long as the tree is only built with this
+ *    function. They're left alone if b couldn't be put in place.
+ *
+ * struct node_s *node_avl_insert(struct node_s **root, struct node_s *n)
+ *  Insert n into the tree at *root, rebalancing as necessary.
+ *
+ * inputs:
+ *  struct node_s **root - the address of the root pointer. Set the root
+ *  pointer to 0 to start a new tree.
+ *  struct node_s *n - the node to insert. It must not have any children
+ *  in its NODE_LEFT or NODE_RIGHT slots.
+ *
+ * output:
+ *  struct node_s * - n, or 0 if it could not be inserted.
+ *
+ * notes:
+ *  - If n has an owner, it is released from it first.
+ *  - Nodes which compare equal are kept, in insertion order.
+ *
+ * struct node_s *node_avl_find(struct node_s *root, const struct node_s *key)
+ *  Find a node in the tree which compares equal to key.
+ *
+ * output:
+ *  struct node_s * - the matching node, or 0 if there isn't one.
+ *
+ * size_t node_bst_rank(struct node_s *root, const struct node_s *key)
+ *  Count the nodes in the tree which compare less than key.
+ */
+#define bst_define(suffix, ntype, diff) \
+int node_bst_insert##suffix(struct node_s *a, struct node_s *b) \
+{ \
+    if(!a || !b || (a->type != b->type) || !bst_typed(ntype, a)) \
+        return 0; \
+\
+    size_t index; \
+    struct node_s *root = a, *next; \
+\
+    /* \
+     * Walk down to the empty slot where b belongs. \
+     */ \
+    for(;; a = next) { \
+        index = diff(a, b) < 0 ? NODE_RIGHT : NODE_LEFT; \
+        if(!(next = node_at(a, index))) \
+            break; \
+    } \
+\
+    if(!node_put(a, index, b)) \
+        return 0; \
+\
+    /* \
+     * Every node on the way back up gains b's subtree, and may have \
+     * grown taller because of it. \
+     */ \
+    for(next = b;; next = a, a = a->owner) { \
+        a->count += b->count; \
+        a->height = MAX(a->height, next->height + 1); \
+        if(a == root) \
+            break; \
+    } \
+\
+    return b->count; \
+} \
+\
+struct node_s *node_avl_insert##suffix(struct node_s **root, struct node_s *n) \
+{ \
+    if(!root || !n || bst_left(n) || bst_right(n) || !bst_typed(ntype, n)) \
+        return 0; \
+\
+    if(*root && (*root)->type != n->type) \
+        return 0; \
+\
+    if(n->owner) \
+        node_release(n->owner, n->id); \
+\
+    n->height = 1; \
+    n->count = 1; \
+\
+    if(!*root) { \
+        *root = n; \
+        return n; \
+    } \
+\
+    size_t index; \
+    struct node_s *p, *next; \
+\
+    for(p = *root;; p = next) { \
+        index = diff(p, n) > 0 ? NODE_LEFT : NODE_RIGHT; \
+        if(!(next = node_at(p, index))) \
+            break; \
+    } \
+\
+    node_set(p, index, n); \
+    bst_fix(root, p); \
+\
+    return n; \
+} \
+\
+struct node_s *node_avl_find##suffix(struct node_s *root, \
+    const struct node_s *key) \
+{ \
+    int d; \
+\
+    if(!root || !key || (root->type != key->type) || !bst_typed(ntype, key)) \
+        return 0; \
+\
+    while(root && (d = diff(root, key))) \
+        root = node_at(root, d < 0 ? NODE_RIGHT : NODE_LEFT); \
+\
+    return root; \
+} \
+\
+size_t node_bst_rank##suffix(struct node_s *root, const struct node_s *key) \
+{ \
+    size_t rank = 0; \
+\
+    if(!root || !key || (root->type != key->type) || !bst_typed(ntype, key)) \
+        return 0; \
+\
+    while(root) { \
+        if(diff(root, key) < 0) { \
+            rank += node_count(bst_left(root)) + 1; \
+            root = bst_right(root); \
+        } else { \
+            root = bst_left(root); \
+        } \
+    } \
+\
+    return rank; \
+}
+
+#define bst_int_diff(a, b) int_data_diff((a)->data, (b)->data)
+#define bst_str_diff(a, b) str_data_diff((a)->data, (b)->data)
+
+/*
+ * The generic versions, and the integer and string ones: node_bst_insert_int,
+ * node_avl_find_str and so on. The specialized versions refuse nodes of
+ * any other type.
+ */
+bst_define(, 0, node_diff)
+bst_define(_int, node_type_int, bst_int_diff)
+bst_define(_str, node_type_str, bst_str_diff)
+
+/*
+ * struct node_s *node_avl_remove(struct node_s **root, struct node_s *z)
+ *  Unlink z from the tree at *root, rebalancing as necessary.
+ *
+ * output:
+ *  struct node_s * - z, now without an owner or children, or 0 if
+ *  nothing was removed. It's yours to free or reuse.
+ *
+ * notes:
+ *  - z must belong to the tree.
+ */
+struct node_s *node_avl_remove(struct node_s **root, struct node_s *z)
+{
+    if(!root || !*root || !z)
+        return 0;
+
+    struct node_s *l = bst_left(z), *r = bst_right(z), *s, *start;
+
+    if(l && r) {
+        /*
+         * Put z's successor (the leftmost node of its right subtree)
+         * in its place.
+         */
+        for(s = r; bst_left(s); s = bst_left(s))
+            ;
+
+        if(s != r) {
+            start = s->owner;
+            node_set(start, NODE_LEFT, bst_right(s));
+            node_set(s, NODE_RIGHT, r);
+        } else {
+            start = s;
+        }
+
+        node_set(s, NODE_LEFT, l);
+        bst_replace(root, z, s);
+
+    } else {
+        /*
+         * With at most one child, the child simply moves up.
+         */
+        start = z == *root ? 0 : z->owner;
+        bst_replace(root, z, l ? l : r);
+    }
+
+    node_set(z, NODE_LEFT, 0);
+    node_set(z, NODE_RIGHT, 0);
+    z->owner = 0;
+    z->id = 0;
+    z->height = 1;
+    z->count = 1;
+
+    bst_fix(root, start);
+
+    return z;
+}
+
+/*
+ * struct node_s *node_avl_delete(struct node_s **root,
+ *  const struct node_s *key)
+ *  Find and remove a node which compares equal to key.
+ *
+ * output:
+ *  struct node_s * - the removed node, or 0 if there wasn't one.
+ */
+struct node_s *node_avl_delete(struct node_s **root, const struct node_s *key)
+{
+    if(!root)
+        return 0;
+
+    return node_avl_remove(root, node_avl_find(*root, key));
+}
+
+/*
+ * struct node_s *node_bst_build(struct node_s **nodes, size_t count)
+ *  Make a perfectly balanced binary search tree out of an array of nodes.
+ *
+ * inputs:
+ *  struct node_s **nodes - the nodes, all of the same type and without
+ *  any children in their NODE_LEFT or NODE_RIGHT slots. The array is
+ *  sorted in place unless it is sorted already.
+ *  size_t count - the number of nodes.
+ *
+ * output:
+ *  struct node_s * - the root of the new tree, or 0 if the nodes
+ *  weren't suitable.
+ *
+ * notes:
+ *  - Takes O(n) time on sorted input and O(n log n) otherwise, compared
+ *    with O(n log n) for n calls to node_avl_insert and O(n^2) for n
+ *    calls to node_bst_insert with sorted input.
+ *  - Nodes with an owner are released from it first.
+ *  - Trees of at least BST_PARALLEL_MIN nodes are built by several
+ *    threads, unless any of the nodes has an allocator which isn't
+ *    thread_safe (such as the node pool, which belongs to the calling
+ *    thread).
+ */
+struct node_s *node_bst_build(struct node_s **nodes, size_t count)
+{
+    bool sorted = true, shared = true;
+    size_t i;
+
+    if(!nodes || !count)
+        return 0;
+
+    for(i = 0; i < count; i++) {
+        if(!nodes[i] || bst_left(nodes[i]) || bst_right(nodes[i]) ||
+            (nodes[i]->type != nodes[0]->type))
+            return 0;
+
+        if(i && node_diff(nodes[i - 1], nodes[i]) > 0)
+            sorted = false;
+
+        shared &= nodes[i]->alloc->thread_safe;
+    }
+
+    for(i = 0; i < count; i++)
+        if(nodes[i]->owner)
+            node_release(nodes[i]->owner, nodes[i]->id);
+
+    if(!sorted)
+        qsort(nodes, count, sizeof(struct node_s *), bst_sort_diff);
+
+    struct bst_build_s b = {
+        nodes, count, shared ? BST_PARALLEL_DEPTH : 0, 0
+    };
+    bst_build(&b);
+
+    return b.root;
+}
+
+/*
+ * struct node_s *node_bst_select(struct node_s *root, size_t k)
+ *  Find the node with k nodes before it in order. ie. node_bst_select(t, 0)
+ *  is the smallest node and node_bst_select(t, t->count - 1) the largest.
+ *
+ * output:
+ *  struct node_s * - the k-th node, or 0 if the tree has k or fewer nodes.
+ */
+struct node_s *node_bst_select(struct node_s *root, size_t k)
+{
+    size_t l;
+
+    while(root) {
+        l = node_count(bst_left(root));
+
+        if(k == l)
+            break;
+
+        if(k < l) {
+            root = bst_left(root);
+        } else {
+            k -= l + 1;
+            root = bst_right(root);
+        }
+    }
+
+    return root;
+}
+
+/*
+ * size_t node_bst_range(struct node_s *root, const struct node_s *lo,
+ *  const struct node_s *hi, void (*iter)(struct node_s *))
+ *  Pass every node between lo and hi (inclusive) to iter, in order.
+ *
+ * output:
+ *  size_t - the number of nodes visited.
+ *
+ * notes:
+ *  - iter may be 0, in which case the nodes are only counted. To count
+ *    without visiting use node_bst_rank instead.
+ */
+size_t node_bst_range(struct node_s *root, const struct node_s *lo,
+    const struct node_s *hi, void (*iter)(struct node_s *))
+{
+    struct node_s *n, *first = 0;
+    size_t len = 0;
+
+    if(!root || !lo || !hi || (root->type != lo->type) ||
+        (root->type != hi->type))
+        return 0;
+
+    /*
+     * Find the first node which doesn't compare less than lo.
+     */
+    for(n = root; n;) {
+        if(node_diff(n, lo) < 0) {
+            n = bst_right(n);
+        } else {
+            first = n;
+            n = bst_left(n);
+        }
+    }
+
+    for(n = first; n && node_diff(n, hi) <= 0; n = node_bt_next(root, n, NODE_IN_ORDER)) {
+        if(iter)
+            iter(n);
+
+        len++;
+    }
+
+    return len;
+}
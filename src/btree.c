@@ -0,0 +1,662 @@
+/*
+ * btree.c
+ *
+ * An ordered set of values kept in a B-tree.
+ *
+ * Every page other than the root holds between degree - 1 and
+ * 2 * degree - 1 values, stored one after the other, and an internal
+ * page with n values has n + 1 children. The degree is picked so that a
+ * page's values take up about BTREE_PAGE_SIZE bytes, and lookups within a
+ * page are binary searches.
+ *
+ * Insertion and deletion both make a single pass down from the root.
+ * On the way down, insertion splits any full page before entering it and
+ * deletion tops up any page with only degree - 1 values, either by
+ * borrowing from a sibling or by merging with one, so there is never any
+ * need to come back up. Values are moved around with memcpy; only the
+ * value being inserted is passed to the type's 'init' and only the value
+ * being deleted to its 'fini'.
+ */
+#include "common.h"
+
+#define BTREE_PAGE_SIZE 512
+#define BTREE_MIN_DEGREE 4
+
+/*
+ * The values of a page, followed by its children if it isn't a leaf.
+ */
+struct btree_page_s {
+    size_t len;
+    bool leaf;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+/*
+ * macros
+ */
+#define btree_max(b) (2 * (b)->degree - 1)
+#define btree_size(b) ((b)->type->size)
+
+/*
+ * The number of bytes set aside for values in a page, rounded up so that
+ * the children which follow them are aligned.
+ */
+#define btree_values_size(b) \
+    ((btree_max(b) * btree_size(b) + sizeof(void *) - 1) & ~(sizeof(void *) - 1))
+
+#define btree_value(b, p, i) ((void *) ((p)->data + (i) * btree_size(b)))
+#define btree_children(b, p) \
+    ((struct btree_page_s **) ((p)->data + btree_values_size(b)))
+#define btree_child(b, p, i) btree_children(b, p)[i]
+
+/*
+ * What btree_take takes out of a subtree.
+ */
+enum btree_take_e {
+    BTREE_TAKE_VALUE,
+    BTREE_TAKE_MIN,
+    BTREE_TAKE_MAX
+};
+
+/*
+ * static functions
+ */
+
+static size_t btree_page_size(const struct btree_s *b, bool leaf)
+{
+    size_t size = sizeof(struct btree_page_s) + btree_values_size(b);
+
+    if(!leaf)
+        size += sizeof(struct btree_page_s *) * (btree_max(b) + 1);
+
+    return size;
+}
+
+static struct btree_page_s *btree_page_new(const struct btree_s *b, bool leaf)
+{
+    struct btree_page_s *p = (struct btree_page_s *)
+        node_mem_alloc(b->alloc, btree_page_size(b, leaf));
+    if(!p)
+        return 0;
+
+    p->len = 0;
+    p->leaf = leaf;
+
+    return p;
+}
+
+/*
+ * Free a single page, but none of its values or children.
+ */
+static void btree_page_drop(const struct btree_s *b, struct btree_page_s *p)
+{
+    node_mem_free(b->alloc, p, btree_page_size(b, p->leaf));
+}
+
+/*
+ * static void btree_page_free(const struct btree_s *b, struct btree_page_s *p)
+ * Free a page, everything below it and all of their values. This recurses
+ * once per level of the tree, which is never more than a handful.
+ */
+static void btree_page_free(const struct btree_s *b, struct btree_page_s *p)
+{
+    size_t i;
+
+    if(!p)
+        return;
+
+    for(i = 0; b->type->fini && i < p->len; i++)
+        b->type->fini(btree_value(b, p, i), b->alloc);
+
+    for(i = 0; !p->leaf && i <= p->len; i++)
+        btree_page_free(b, btree_child(b, p, i));
+
+    btree_page_drop(b, p);
+}
+
+/*
+ * Move n values (and, for internal pages, the children to their right)
+ * within or between pages.
+ */
+static void btree_move(const struct btree_s *b, struct btree_page_s *to,
+    size_t at, struct btree_page_s *from, size_t i, size_t n)
+{
+    memmove(btree_value(b, to, at), btree_value(b, from, i),
+        n * btree_size(b));
+
+    if(!from->leaf)
+        memmove(&btree_child(b, to, at + 1), &btree_child(b, from, i + 1),
+            n * sizeof(struct btree_page_s *));
+}
+
+/*
+ * static size_t btree_search(const struct btree_s *b,
+ *  const struct btree_page_s *p, const void *value, bool *found)
+ * Find the first value in the page which doesn't compare less than value.
+ */
+static size_t btree_search(const struct btree_s *b,
+    const struct btree_page_s *p, const void *value, bool *found)
+{
+    size_t lo = 0, hi = p->len, mid;
+    int diff;
+
+    *found = false;
+
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        diff = b->type->diff(btree_value(b, p, mid), value);
+
+        if(!diff) {
+            *found = true;
+            return mid;
+        }
+
+        if(diff < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/*
+ * static bool btree_split(const struct btree_s *b, struct btree_page_s *p,
+ *  size_t i)
+ * Split p's i-th child, which must be full, in two around its middle
+ * value, which moves up into p. p must not be full.
+ */
+static bool btree_split(const struct btree_s *b, struct btree_page_s *p,
+    size_t i)
+{
+    struct btree_page_s *l = btree_child(b, p, i), *r;
+    size_t t = b->degree;
+
+    if(!(r = btree_page_new(b, l->leaf)))
+        return false;
+
+    /*
+     * The top half of l goes to r.
+     */
+    if(!l->leaf)
+        btree_child(b, r, 0) = btree_child(b, l, t);
+
+    btree_move(b, r, 0, l, t, t - 1);
+    r->len = t - 1;
+    l->len = t - 1;
+
+    /*
+     * Make room in p for the middle value and for r.
+     */
+    btree_move(b, p, i + 1, p, i, p->len - i);
+    memcpy(btree_value(b, p, i), btree_value(b, l, t - 1), btree_size(b));
+    btree_child(b, p, i + 1) = r;
+    p->len++;
+
+    return true;
+}
+
+/*
+ * static void btree_merge(const struct btree_s *b, struct btree_page_s *p,
+ *  size_t i)
+ * Merge p's i-th and i+1-th children, along with the value between them.
+ */
+static void btree_merge(const struct btree_s *b, struct btree_page_s *p,
+    size_t i)
+{
+    struct btree_page_s *l = btree_child(b, p, i),
+        *r = btree_child(b, p, i + 1);
+
+    memcpy(btree_value(b, l, l->len), btree_value(b, p, i), btree_size(b));
+    if(!l->leaf)
+        btree_child(b, l, l->len + 1) = btree_child(b, r, 0);
+
+    btree_move(b, l, l->len + 1, r, 0, r->len);
+    l->len += r->len + 1;
+
+    btree_move(b, p, i, p, i + 1, p->len - i - 1);
+    p->len--;
+
+    btree_page_drop(b, r);
+}
+
+/*
+ * static struct btree_page_s *btree_fill(const struct btree_s *b,
+ *  struct btree_page_s *p, size_t i)
+ * Make sure p's i-th child has more than the minimum number of values
+ * before we descend into it, and return the page to descend into.
+ */
+static struct btree_page_s *btree_fill(const struct btree_s *b,
+    struct btree_page_s *p, size_t i)
+{
+    struct btree_page_s *c = btree_child(b, p, i), *s;
+
+    if(c->len >= b->degree)
+        return c;
+
+    /*
+     * Borrow the last value of the left sibling, by way of p.
+     */
+    if(i && (s = btree_child(b, p, i - 1))->len >= b->degree) {
+        memmove(btree_value(b, c, 1), btree_value(b, c, 0),
+            c->len * btree_size(b));
+        memcpy(btree_value(b, c, 0), btree_value(b, p, i - 1), btree_size(b));
+        memcpy(btree_value(b, p, i - 1), btree_value(b, s, s->len - 1),
+            btree_size(b));
+
+        if(!c->leaf) {
+            memmove(&btree_child(b, c, 1), &btree_child(b, c, 0),
+                (c->len + 1) * sizeof(struct btree_page_s *));
+            btree_child(b, c, 0) = btree_child(b, s, s->len);
+        }
+
+        s->len--;
+        c->len++;
+        return c;
+    }
+
+    /*
+     * Borrow the first value of the right sibling.
+     */
+    if(i < p->len && (s = btree_child(b, p, i + 1))->len >= b->degree) {
+        memcpy(btree_value(b, c, c->len), btree_value(b, p, i), btree_size(b));
+        memcpy(btree_value(b, p, i), btree_value(b, s, 0), btree_size(b));
+
+        if(!c->leaf) {
+            btree_child(b, c, c->len + 1) = btree_child(b, s, 0);
+            memmove(&btree_child(b, s, 0), &btree_child(b, s, 1),
+                s->len * sizeof(struct btree_page_s *));
+        }
+
+        memmove(btree_value(b, s, 0), btree_value(b, s, 1),
+            (s->len - 1) * btree_size(b));
+
+        s->len--;
+        c->len++;
+        return c;
+    }
+
+    /*
+     * Both siblings are as small as they can be, so merge with one.
+     */
+    if(i < p->len) {
+        btree_merge(b, p, i);
+    } else {
+        btree_merge(b, p, i - 1);
+        c = btree_child(b, p, i - 1);
+    }
+
+    return c;
+}
+
+/*
+ * static bool btree_take(const struct btree_s *b, struct btree_page_s *p,
+ *  const void *value, enum btree_take_e what, void *out)
+ * Remove a value from the subtree rooted at p, which must have more than
+ * the minimum number of values unless it's the root, and copy it to out
+ * without finalizing it.
+ */
+static bool btree_take(const struct btree_s *b, struct btree_page_s *p,
+    const void *value, enum btree_take_e what, void *out)
+{
+    struct btree_page_s *l, *r;
+    bool found;
+    size_t i;
+
+    for(;;) {
+        if(what == BTREE_TAKE_VALUE) {
+            i = btree_search(b, p, value, &found);
+        } else {
+            found = p->leaf;
+            i = what == BTREE_TAKE_MIN ? 0 : p->len - p->leaf;
+        }
+
+        if(p->leaf) {
+            if(!found)
+                return false;
+
+            memcpy(out, btree_value(b, p, i), btree_size(b));
+            memmove(btree_value(b, p, i), btree_value(b, p, i + 1),
+                (p->len - i - 1) * btree_size(b));
+            p->len--;
+
+            return true;
+        }
+
+        if(!found) {
+            p = btree_fill(b, p, i);
+            continue;
+        }
+
+        /*
+         * The value is in an internal page. Replace it with its
+         * predecessor or successor, whichever comes from the bigger
+         * page, or failing that merge the pages either side of it and
+         * carry on looking there.
+         */
+        l = btree_child(b, p, i);
+        r = btree_child(b, p, i + 1);
+        memcpy(out, btree_value(b, p, i), btree_size(b));
+
+        if(l->len >= b->degree || r->len >= b->degree) {
+            what = l->len >= b->degree ? BTREE_TAKE_MAX : BTREE_TAKE_MIN;
+            out = btree_value(b, p, i);
+            p = what == BTREE_TAKE_MAX ? l : r;
+        } else {
+            btree_merge(b, p, i);
+            p = l;
+        }
+    }
+}
+
+/*
+ * static size_t btree_walk(const struct btree_s *b,
+ *  const struct btree_page_s *p, const void *lo, const void *hi,
+ *  void (*iter)(struct node_s *), bool *done)
+ * Visit the values of the subtree rooted at p between lo and hi (either
+ * of which may be 0, for no limit) in order. Each value is handed to iter
+ * inside a temporary node, along with any string rendered for it.
+ */
+static size_t btree_walk(const struct btree_s *b,
+    const struct btree_page_s *p, const void *lo, const void *hi,
+    void (*iter)(struct node_s *), bool *done)
+{
+    struct node_s view = { .type = b->type, .count = 1, .height = 1 };
+    size_t i = 0, len = 0;
+    bool found;
+
+    if(lo)
+        i = btree_search(b, p, lo, &found);
+
+    for(; i <= p->len; i++) {
+        if(!p->leaf)
+            len += btree_walk(b, btree_child(b, p, i), lo, hi, iter, done);
+
+        if(*done || i == p->len)
+            break;
+
+        view.data = btree_value(b, p, i);
+        if(hi && b->type->diff(view.data, hi) > 0) {
+            *done = true;
+            break;
+        }
+
+        if(iter) {
+            iter(&view);
+            node_free_all(view.str);
+            view.str = 0;
+        }
+
+        len++;
+    }
+
+    return len;
+}
+
+static bool btree_usable(const struct node_s *tree, const struct node_s *value)
+{
+    return tree && value && (tree->type == node_type_btree) &&
+        (btree_get(tree->data)->type == value->type);
+}
+
+static bool btree_set(void *data, const void *init,
+    const struct node_allocator_s *a)
+{
+    const struct node_type_s *type = (const struct node_type_s *) init;
+    struct btree_s *b = btree_get(data);
+
+    if(!type->init)
+        return false;
+
+    b->type = type;
+    b->alloc = a;
+    b->root = 0;
+    b->len = 0;
+    b->height = 0;
+    b->degree = MAX(BTREE_PAGE_SIZE / type->size / 2, BTREE_MIN_DEGREE);
+
+    return true;
+}
+
+static void btree_clear(void *data, const struct node_allocator_s *a)
+{
+    btree_page_free(btree_get(data), btree_get(data)->root);
+}
+
+static int btree_diff(const void *a, const void *b)
+{
+    return (int) btree_get(a)->len - (int) btree_get(b)->len;
+}
+
+static int btree_print(const void *data, char *buf, size_t size)
+{
+    return snprintf(buf, size, "btree of %lu", btree_get(data)->len);
+}
+
+static struct node_s *btree_to_str(const void *data)
+{
+    char s[100];
+    btree_print(data, s, sizeof(s));
+    return str_node_new(s);
+}
+
+/*
+ * non-static functions
+ */
+
+/*
+ * bool node_btree_insert(struct node_s *tree, const struct node_s *value)
+ *  Add a copy of value to the tree.
+ *
+ * output:
+ *  bool - true if value was added, false if it was already there or
+ *  there wasn't enough memory.
+ */
+bool node_btree_insert(struct node_s *tree, const struct node_s *value)
+{
+    if(!btree_usable(tree, value))
+        return false;
+
+    struct btree_s *b = btree_get(tree->data);
+    struct btree_page_s *p, *root;
+    bool found;
+    size_t i;
+
+    if(!b->root) {
+        if(!(b->root = btree_page_new(b, true)))
+            return false;
+
+        b->height = 1;
+    }
+
+    /*
+     * A full root is split by giving it a new, empty parent.
+     */
+    if(b->root->len == btree_max(b)) {
+        if(!(root = btree_page_new(b, false)))
+            return false;
+
+        btree_child(b, root, 0) = b->root;
+        if(!btree_split(b, root, 0)) {
+            btree_page_drop(b, root);
+            return false;
+        }
+
+        b->root = root;
+        b->height++;
+    }
+
+    for(p = b->root;;) {
+        i = btree_search(b, p, value->data, &found);
+        if(found)
+            return false;
+
+        if(p->leaf)
+            break;
+
+        if(btree_child(b, p, i)->len == btree_max(b)) {
+            if(!btree_split(b, p, i))
+                return false;
+
+            /*
+             * The value which moved up may be the one we're inserting,
+             * or we may now belong to its right.
+             */
+            int diff = b->type->diff(btree_value(b, p, i), value->data);
+            if(!diff)
+                return false;
+
+            if(diff < 0)
+                i++;
+        }
+
+        p = btree_child(b, p, i);
+    }
+
+    memmove(btree_value(b, p, i + 1), btree_value(b, p, i),
+        (p->len - i) * btree_size(b));
+
+    if(!b->type->init(btree_value(b, p, i), value->data, b->alloc)) {
+        memmove(btree_value(b, p, i), btree_value(b, p, i + 1),
+            (p->len - i) * btree_size(b));
+        return false;
+    }
+
+    p->len++;
+    b->len++;
+
+    return true;
+}
+
+/*
+ * const void *node_btree_find(const struct node_s *tree,
+ *  const struct node_s *value)
+ *  Look for a value in the tree.
+ *
+ * output:
+ *  const void * - the tree's copy of the value's data, or 0 if it isn't
+ *  there. It stays valid until the tree is next modified.
+ */
+const void *node_btree_find(const struct node_s *tree,
+    const struct node_s *value)
+{
+    if(!btree_usable(tree, value))
+        return 0;
+
+    const struct btree_s *b = btree_get(tree->data);
+    const struct btree_page_s *p = b->root;
+    bool found;
+    size_t i;
+
+    while(p) {
+        i = btree_search(b, p, value->data, &found);
+        if(found)
+            return btree_value(b, p, i);
+
+        p = p->leaf ? 0 : btree_child(b, p, i);
+    }
+
+    return 0;
+}
+
+/*
+ * bool node_btree_delete(struct node_s *tree, const struct node_s *value)
+ *  Remove a value from the tree.
+ *
+ * output:
+ *  bool - true if the value was there.
+ */
+bool node_btree_delete(struct node_s *tree, const struct node_s *value)
+{
+    if(!btree_usable(tree, value))
+        return false;
+
+    struct btree_s *b = btree_get(tree->data);
+    struct btree_page_s *root = b->root;
+
+    if(!root)
+        return false;
+
+    _Alignas(max_align_t) unsigned char out[btree_size(b)];
+    bool taken = btree_take(b, root, value->data, BTREE_TAKE_VALUE, out);
+
+    if(taken) {
+        if(b->type->fini)
+            b->type->fini(out, b->alloc);
+
+        b->len--;
+    }
+
+    /*
+     * Merging the root's last two children, or taking the last value,
+     * leaves the root empty.
+     */
+    if(!root->len) {
+        b->root = root->leaf ? 0 : btree_child(b, root, 0);
+        b->height--;
+        btree_page_drop(b, root);
+    }
+
+    return taken;
+}
+
+/*
+ * size_t node_btree_range(const struct node_s *tree, const struct node_s *lo,
+ *  const struct node_s *hi, void (*iter)(struct node_s *))
+ *  Pass every value between lo and hi (inclusive) to iter, in order.
+ *
+ * inputs:
+ *  lo, hi - the limits of the range. Either may be 0 for no limit.
+ *  iter - called with a temporary node for each value. It may be 0, in
+ *  which case the values are only counted.
+ *
+ * output:
+ *  size_t - the number of values visited.
+ *
+ * notes:
+ *  - iter must not modify the tree, nor keep or free the node.
+ */
+size_t node_btree_range(const struct node_s *tree, const struct node_s *lo,
+    const struct node_s *hi, void (*iter)(struct node_s *))
+{
+    bool done = false;
+
+    if(!tree || (lo && !btree_usable(tree, lo)) || (hi && !btree_usable(tree, hi)))
+        return 0;
+
+    const struct btree_s *b = btree_get(tree->data);
+    if(!b->root)
+        return 0;
+
+    return btree_walk(b, b->root, lo ? lo->data : 0, hi ? hi->data : 0, iter,
+        &done);
+}
+
+/*
+ * size_t node_btree_for_each(const struct node_s *tree,
+ *  void (*iter)(struct node_s *))
+ *  Pass every value in the tree to iter, in order. See node_btree_range.
+ */
+size_t node_btree_for_each(const struct node_s *tree,
+    void (*iter)(struct node_s *))
+{
+    if(!tree || (tree->type != node_type_btree))
+        return 0;
+
+    return node_btree_range(tree, 0, 0, iter);
+}
+
+/*
+ * The B-tree type
+ */
+static const struct node_type_s _type_btree = {
+    .size = sizeof(struct btree_s),
+    .init = btree_set,
+    .fini = btree_clear,
+    .diff = btree_diff,
+    .to_str = btree_to_str,
+    .print = btree_print,
+    .name = "btree"
+};
+
+const struct node_type_s *node_type_btree = &_type_btree;
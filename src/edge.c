@@ -0,0 +1,72 @@
+#include "common.h"
+
+static bool edge_set(void *data, const void *init,
+    const struct node_allocator_s *a)
+{
+    *edge_get(data) = *(const struct edge_s *) init;
+    return true;
+}
+
+/*
+ * Edges sort by weight, then by where they lead.
+ */
+static int edge_diff(const void *a, const void *b)
+{
+    const struct edge_s *x = edge_get(a), *y = edge_get(b);
+
+    if(x->weight != y->weight)
+        return (x->weight > y->weight) - (x->weight < y->weight);
+
+    return (x->to > y->to) - (x->to < y->to);
+}
+
+/*
+ * Only the weight is saved. Whoever loads the edge (see serial.c) is left
+ * to point it somewhere.
+ */
+static size_t edge_serialize(const void *d, void *buf, size_t size)
+{
+    if(size >= sizeof(double))
+        memcpy(buf, &edge_get(d)->weight, sizeof(double));
+
+    return sizeof(double);
+}
+
+static bool edge_deserialize(void *data, const void *buf, size_t size,
+    const struct node_allocator_s *a)
+{
+    if(size != sizeof(double))
+        return false;
+
+    edge_get(data)->to = 0;
+    memcpy(&edge_get(data)->weight, buf, sizeof(double));
+    return true;
+}
+
+static int edge_print(const void *d, char *buf, size_t size)
+{
+    char to[100];
+
+    node_render(edge_get(d)->to, to, sizeof(to));
+    return snprintf(buf, size, "-> %s (%g)", to, edge_get(d)->weight);
+}
+
+static struct node_s *edge_to_str(const void *d)
+{
+    char s[200];
+    edge_print(d, s, sizeof(s));
+    return str_node_new(s);
+}
+
+static const struct node_type_s _type_edge = {
+    .size = sizeof(struct edge_s),
+    .init = edge_set,
+    .diff = edge_diff,
+    .to_str = edge_to_str,
+    .print = edge_print,
+    .serialize = edge_serialize,
+    .deserialize = edge_deserialize,
+    .name = "edge"
+};
+
+const struct node_type_s *node_type_edge = &_type_edge;
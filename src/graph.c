@@ -0,0 +1,811 @@
+/*
+ * graph.c
+ *
+ * Graphs of nodes, and compressed sparse row snapshots of them.
+ *
+ * Freezing a graph takes two passes over its vertices: the first counts
+ * each vertex's edges, which gives the offsets, and the second fills in
+ * the targets. An edge's target is found in constant time from its owner
+ * and id, which are the graph and the target's index within it.
+ *
+ * The parallel BFS goes one level at a time. The threads split the
+ * current frontier between them and claim the unvisited neighbors they
+ * find by setting their flag in a shared array. Whoever sets a flag
+ * first records the vertex's distance and adds it to the next frontier,
+ * in batches so that the threads rarely touch the same counter.
+ *
+ * The shortest path searches keep the vertices they have reached but not
+ * yet settled in a binary heap ordered by distance (plus the heuristic's
+ * estimate, for A*). The heap knows where each vertex is within it, so
+ * when a shorter path to a vertex turns up, the vertex is moved up in
+ * place rather than added a second time.
+ */
+#include "common.h"
+#include <stdatomic.h>
+
+/*
+ * Graphs with fewer vertices than this aren't worth starting threads for.
+ */
+#define GRAPH_PARALLEL_MIN (1 << 14)
+
+/*
+ * The number of vertices a BFS thread collects before adding them to the
+ * next frontier.
+ */
+#define GRAPH_BATCH 256
+
+/*
+ * Allocate and free arrays of n items of type t with a snapshot's
+ * allocator.
+ */
+#define graph_mem_alloc(g, n, t) \
+    ((t *) node_mem_alloc((g)->alloc, sizeof(t) * (n)))
+#define graph_mem_free(g, p, n, t) node_mem_free((g)->alloc, p, sizeof(t) * (n))
+
+/*
+ * The state shared by the threads of a parallel BFS.
+ */
+struct graph_bfs_s {
+    const struct graph_s *g;
+    size_t *dist, *frontier, *next, len, level, reached;
+    atomic_size_t next_len;
+    atomic_uchar *seen;
+    pthread_barrier_t barrier;
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    bool started;
+    unsigned threads;
+};
+
+struct graph_worker_s {
+    struct graph_bfs_s *b;
+    unsigned id;
+};
+
+/*
+ * An indexed binary heap of vertices, ordered by key. pos[v] is v's
+ * index within heap, or GRAPH_NONE if it isn't in the heap.
+ */
+struct graph_heap_s {
+    size_t *heap, *pos, len;
+    const double *key;
+};
+
+/*
+ * static functions
+ */
+
+/*
+ * static size_t graph_target(const struct node_s *g, const struct node_s *c,
+ *  double *weight)
+ * The index of the vertex an edge leads to, or GRAPH_NONE if c isn't an
+ * edge to one of g's vertices. The edge's weight goes in *weight.
+ */
+static size_t graph_target(const struct node_s *g, const struct node_s *c,
+    double *weight)
+{
+    const struct node_s *t;
+
+    if(!c)
+        return GRAPH_NONE;
+
+    if(c->type == node_type_edge) {
+        t = edge_node_to(c);
+        *weight = edge_node_weight(c);
+    } else if(c->type == node_type_node) {
+        t = node_data(c);
+        *weight = 1;
+    } else {
+        return GRAPH_NONE;
+    }
+
+    return t && t->owner == g ? t->id : GRAPH_NONE;
+}
+
+/*
+ * static size_t graph_find(size_t *parent, size_t v)
+ * Find the root of v's set, halving the path to it on the way.
+ */
+static size_t graph_find(size_t *parent, size_t v)
+{
+    while(parent[v] != v) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+
+    return v;
+}
+
+/*
+ * static void graph_heap_up(struct graph_heap_s *q, size_t i)
+ * Move the vertex at index i of the heap up until its parent's key is no
+ * larger than its own.
+ */
+static void graph_heap_up(struct graph_heap_s *q, size_t i)
+{
+    size_t v = q->heap[i], p;
+
+    for(; i && q->key[q->heap[p = (i - 1) >> 1]] > q->key[v]; i = p) {
+        q->heap[i] = q->heap[p];
+        q->pos[q->heap[i]] = i;
+    }
+
+    q->heap[i] = v;
+    q->pos[v] = i;
+}
+
+/*
+ * static void graph_heap_down(struct graph_heap_s *q, size_t i)
+ * Move the vertex at index i of the heap down until neither of its
+ * children has a smaller key.
+ */
+static void graph_heap_down(struct graph_heap_s *q, size_t i)
+{
+    size_t v = q->heap[i], c;
+
+    while((c = (i << 1) + 1) < q->len) {
+        if(c + 1 < q->len && q->key[q->heap[c + 1]] < q->key[q->heap[c]])
+            c++;
+
+        if(q->key[q->heap[c]] >= q->key[v])
+            break;
+
+        q->heap[i] = q->heap[c];
+        q->pos[q->heap[i]] = i;
+        i = c;
+    }
+
+    q->heap[i] = v;
+    q->pos[v] = i;
+}
+
+/*
+ * static void graph_heap_push(struct graph_heap_s *q, size_t v)
+ * Add v to the heap, or move it up if its key has gone down since it
+ * was added.
+ */
+static void graph_heap_push(struct graph_heap_s *q, size_t v)
+{
+    if(q->pos[v] == GRAPH_NONE) {
+        q->heap[q->len] = v;
+        graph_heap_up(q, q->len++);
+    } else {
+        graph_heap_up(q, q->pos[v]);
+    }
+}
+
+static size_t graph_heap_pop(struct graph_heap_s *q)
+{
+    size_t v = q->heap[0];
+
+    q->pos[v] = GRAPH_NONE;
+    if(--q->len) {
+        q->heap[0] = q->heap[q->len];
+        graph_heap_down(q, 0);
+    }
+
+    return v;
+}
+
+/*
+ * static size_t graph_search(const struct graph_s *g, size_t source,
+ *  size_t target, double (*h)(const struct node_s *,
+ *  const struct node_s *, void *), void *ctx, double *dist, size_t *prev)
+ * Find the shortest paths from source, until target is settled or, if
+ * target is GRAPH_NONE, until every reachable vertex is. dist[v] is set
+ * to the length of the shortest path to v (INFINITY if there isn't one)
+ * and prev[v], unless prev is 0, to the vertex before v on that path.
+ *
+ * If h is given, vertices are taken in order of their distance plus
+ * h's estimate of how far they are from target. With a heuristic which
+ * overestimates now and then, a vertex may be settled more than once.
+ *
+ * output:
+ *  size_t - the number of vertices settled, or 0 if there wasn't enough
+ *  memory.
+ */
+static size_t graph_search(const struct graph_s *g, size_t source,
+    size_t target, double (*h)(const struct node_s *, const struct node_s *,
+    void *), void *ctx, double *dist, size_t *prev)
+{
+    struct graph_heap_s q = {
+        .heap = graph_mem_alloc(g, g->nverts, size_t),
+        .pos = graph_mem_alloc(g, g->nverts, size_t)
+    };
+    double *key = h ? graph_mem_alloc(g, g->nverts, double) : dist, d;
+    size_t settled = 0, v, u, k;
+
+    if(!q.heap || !q.pos || !key) {
+        graph_mem_free(g, q.heap, g->nverts, size_t);
+        graph_mem_free(g, q.pos, g->nverts, size_t);
+        if(h)
+            graph_mem_free(g, key, g->nverts, double);
+
+        return 0;
+    }
+
+    for(v = 0; v < g->nverts; v++) {
+        dist[v] = INFINITY;
+        q.pos[v] = GRAPH_NONE;
+        if(prev)
+            prev[v] = GRAPH_NONE;
+    }
+
+    q.key = key;
+    dist[source] = 0;
+    if(h)
+        key[source] = h(g->verts[source], g->verts[target], ctx);
+
+    graph_heap_push(&q, source);
+
+    while(q.len) {
+        v = graph_heap_pop(&q);
+        settled++;
+
+        if(v == target)
+            break;
+
+        for(k = g->offsets[v]; k < g->offsets[v + 1]; k++) {
+            u = g->targets[k];
+
+            if((d = dist[v] + g->weights[k]) >= dist[u])
+                continue;
+
+            dist[u] = d;
+            if(prev)
+                prev[u] = v;
+
+            if(h)
+                key[u] = d + h(g->verts[u], g->verts[target], ctx);
+
+            graph_heap_push(&q, u);
+        }
+    }
+
+    graph_mem_free(g, q.heap, g->nverts, size_t);
+    graph_mem_free(g, q.pos, g->nverts, size_t);
+    if(h)
+        graph_mem_free(g, key, g->nverts, double);
+
+    return settled;
+}
+
+/*
+ * static void graph_flush(struct graph_bfs_s *b, size_t *batch, size_t len)
+ * Add a batch of newly reached vertices to the next frontier.
+ */
+static void graph_flush(struct graph_bfs_s *b, size_t *batch, size_t len)
+{
+    size_t at = atomic_fetch_add_explicit(&b->next_len, len,
+        memory_order_relaxed);
+
+    memcpy(b->next + at, batch, sizeof(size_t) * len);
+}
+
+/*
+ * static void *graph_bfs_worker(void *arg)
+ * Run one thread's share of a parallel BFS, a level at a time, until the
+ * frontier runs out.
+ */
+static void *graph_bfs_worker(void *arg)
+{
+    struct graph_worker_s *w = (struct graph_worker_s *) arg;
+    struct graph_bfs_s *b = w->b;
+    const struct graph_s *g = b->g;
+    size_t batch[GRAPH_BATCH], len, i, from, to, *e, *end;
+
+    /*
+     * Wait until all the threads have been started, since until then
+     * nobody knows how many there are.
+     */
+    pthread_mutex_lock(&b->lock);
+    while(!b->started)
+        pthread_cond_wait(&b->ready, &b->lock);
+    pthread_mutex_unlock(&b->lock);
+
+    while(b->len) {
+        from = b->len * w->id / b->threads;
+        to = b->len * (w->id + 1) / b->threads;
+
+        for(i = from, len = 0; i < to; i++) {
+            e = graph_neighbors(g, b->frontier[i]);
+            end = e + graph_degree(g, b->frontier[i]);
+
+            for(; e < end; e++) {
+                /*
+                 * Check before trying to claim the vertex, since most
+                 * neighbors will have been seen already.
+                 */
+                if(atomic_load_explicit(&b->seen[*e], memory_order_relaxed) ||
+                    atomic_exchange_explicit(&b->seen[*e], 1,
+                    memory_order_relaxed))
+                    continue;
+
+                b->dist[*e] = b->level + 1;
+                batch[len++] = *e;
+
+                if(len == GRAPH_BATCH) {
+                    graph_flush(b, batch, len);
+                    len = 0;
+                }
+            }
+        }
+
+        graph_flush(b, batch, len);
+
+        /*
+         * Once everybody is done with this level, one thread moves on to
+         * the next and the others wait for it.
+         */
+        if(pthread_barrier_wait(&b->barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+            size_t *t = b->frontier;
+
+            b->frontier = b->next;
+            b->next = t;
+            b->len = atomic_load_explicit(&b->next_len, memory_order_relaxed);
+            b->reached += b->len;
+            b->level++;
+            atomic_store_explicit(&b->next_len, 0, memory_order_relaxed);
+        }
+
+        pthread_barrier_wait(&b->barrier);
+    }
+
+    return 0;
+}
+
+/*
+ * non-static functions
+ */
+
+/*
+ * struct node_s *node_graph_connect(struct node_s *from,
+ *  const struct node_s *to)
+ *  Add an edge from one vertex to another. Both must belong to the same
+ *  graph for the edge to count.
+ *
+ * output:
+ *  struct node_s * - the edge, which belongs to from.
+ */
+struct node_s *node_graph_connect(struct node_s *from,
+    const struct node_s *to)
+{
+    if(!from || !to)
+        return 0;
+
+    struct node_s *e = node_new_node_const(to);
+
+    if(e && !node_push(from, e)) {
+        node_free_one(e);
+        return 0;
+    }
+
+    return e;
+}
+
+/*
+ * struct graph_s *node_graph_freeze(const struct node_s *g)
+ *  Make a compressed sparse row snapshot of a graph, with a vertex for
+ *  every slot in g's table (including empty ones, which have no edges).
+ *
+ * output:
+ *  struct graph_s * - the snapshot, to be freed with graph_free, or 0 if
+ *  there wasn't enough memory.
+ *
+ * notes:
+ *  - The snapshot is allocated with g's allocator.
+ */
+struct graph_s *node_graph_freeze(const struct node_s *g)
+{
+    if(!g)
+        return 0;
+
+    struct graph_s *f = (struct graph_s *)
+        node_mem_alloc(g->alloc, sizeof(struct graph_s));
+    struct node_s *v;
+    size_t i, j, k, t;
+    double w;
+
+    if(!f)
+        return 0;
+
+    memset(f, 0, sizeof(struct graph_s));
+    f->alloc = g->alloc;
+    f->nverts = g->len;
+    f->offsets = graph_mem_alloc(f, g->len + 1, size_t);
+    f->verts = graph_mem_alloc(f, g->len ? g->len : 1, struct node_s *);
+
+    if(!f->offsets || !f->verts) {
+        graph_free(f);
+        return 0;
+    }
+
+    for(i = 0; i < g->len; i++) {
+        f->offsets[i] = f->nedges;
+        f->verts[i] = v = g->table[i];
+
+        for(j = 0; v && j < v->len; j++)
+            f->nedges += graph_target(g, v->table[j], &w) != GRAPH_NONE;
+    }
+
+    f->offsets[g->len] = f->nedges;
+
+    f->targets = graph_mem_alloc(f, f->nedges ? f->nedges : 1, size_t);
+    f->weights = graph_mem_alloc(f, f->nedges ? f->nedges : 1, double);
+
+    if(!f->targets || !f->weights) {
+        graph_free(f);
+        return 0;
+    }
+
+    for(i = 0, k = 0; i < g->len; i++) {
+        for(j = 0, v = g->table[i]; v && j < v->len; j++) {
+            if((t = graph_target(g, v->table[j], &w)) != GRAPH_NONE) {
+                f->weights[k] = w;
+                f->targets[k++] = t;
+            }
+        }
+    }
+
+    return f;
+}
+
+/*
+ * void graph_free(struct graph_s *g)
+ *  Free a snapshot. The graph it was made from is left alone.
+ */
+void graph_free(struct graph_s *g)
+{
+    if(!g)
+        return;
+
+    size_t e = g->nedges ? g->nedges : 1;
+
+    graph_mem_free(g, g->offsets, g->nverts + 1, size_t);
+    graph_mem_free(g, g->targets, e, size_t);
+    graph_mem_free(g, g->weights, e, double);
+    graph_mem_free(g, g->verts, g->nverts ? g->nverts : 1, struct node_s *);
+    node_mem_free(g->alloc, g, sizeof(struct graph_s));
+}
+
+/*
+ * size_t graph_bfs(const struct graph_s *g, size_t source, size_t *dist)
+ *  Breadth-first search from source, setting dist[v] to the number of
+ *  edges on the shortest path to each vertex v.
+ *
+ * output:
+ *  size_t - the number of vertices reached, including source.
+ */
+size_t graph_bfs(const struct graph_s *g, size_t source, size_t *dist)
+{
+    if(!g || !dist || source >= g->nverts)
+        return 0;
+
+    size_t *queue = graph_mem_alloc(g, g->nverts, size_t),
+        head = 0, tail = 0, v, *e, *end;
+
+    if(!queue)
+        return 0;
+
+    for(v = 0; v < g->nverts; v++)
+        dist[v] = GRAPH_NONE;
+
+    dist[source] = 0;
+    queue[tail++] = source;
+
+    while(head < tail) {
+        v = queue[head++];
+        e = graph_neighbors(g, v);
+        end = e + graph_degree(g, v);
+
+        for(; e < end; e++) {
+            if(dist[*e] == GRAPH_NONE) {
+                dist[*e] = dist[v] + 1;
+                queue[tail++] = *e;
+            }
+        }
+    }
+
+    graph_mem_free(g, queue, g->nverts, size_t);
+
+    return tail;
+}
+
+/*
+ * size_t graph_bfs_parallel(const struct graph_s *g, size_t source,
+ *  size_t *dist, unsigned threads)
+ *  The same as graph_bfs, but using up to the given number of threads
+ *  (the calling thread being one of them).
+ *
+ * notes:
+ *  - Graphs with fewer than GRAPH_PARALLEL_MIN vertices are searched by
+ *    the calling thread alone, as they are if threads can't be started.
+ */
+size_t graph_bfs_parallel(const struct graph_s *g, size_t source,
+    size_t *dist, unsigned threads)
+{
+    if(!g || !dist || source >= g->nverts)
+        return 0;
+
+    if(threads < 2 || g->nverts < GRAPH_PARALLEL_MIN)
+        return graph_bfs(g, source, dist);
+
+    struct graph_bfs_s b = {
+        .g = g,
+        .dist = dist,
+        .frontier = graph_mem_alloc(g, g->nverts, size_t),
+        .next = graph_mem_alloc(g, g->nverts, size_t),
+        .len = 1,
+        .reached = 1,
+        .seen = graph_mem_alloc(g, g->nverts, atomic_uchar),
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .ready = PTHREAD_COND_INITIALIZER
+    };
+    struct graph_worker_s *w =
+        graph_mem_alloc(g, threads, struct graph_worker_s);
+    pthread_t *t = graph_mem_alloc(g, threads, pthread_t);
+    size_t v, reached = 0;
+    unsigned i;
+
+    if(b.frontier && b.next && b.seen && w && t) {
+        for(v = 0; v < g->nverts; v++) {
+            dist[v] = GRAPH_NONE;
+            atomic_init(&b.seen[v], 0);
+        }
+
+        atomic_init(&b.next_len, 0);
+        atomic_store_explicit(&b.seen[source], 1, memory_order_relaxed);
+        dist[source] = 0;
+        b.frontier[0] = source;
+
+        /*
+         * Go with however many threads could be started. If the barrier
+         * can't be set up either, the empty frontier sends them all home.
+         */
+        pthread_mutex_lock(&b.lock);
+        for(i = 1; i < threads; i++) {
+            w[i].b = &b;
+            w[i].id = i;
+            if(pthread_create(&t[i], 0, graph_bfs_worker, &w[i]))
+                break;
+        }
+
+        b.threads = i;
+        if(pthread_barrier_init(&b.barrier, 0, b.threads))
+            b.len = 0;
+
+        b.started = true;
+        pthread_cond_broadcast(&b.ready);
+        pthread_mutex_unlock(&b.lock);
+
+        if(b.len) {
+            w[0].b = &b;
+            w[0].id = 0;
+            graph_bfs_worker(&w[0]);
+            reached = b.reached;
+        }
+
+        while(--i)
+            pthread_join(t[i], 0);
+
+        if(reached)
+            pthread_barrier_destroy(&b.barrier);
+    }
+
+    graph_mem_free(g, b.frontier, g->nverts, size_t);
+    graph_mem_free(g, b.next, g->nverts, size_t);
+    graph_mem_free(g, b.seen, g->nverts, atomic_uchar);
+    graph_mem_free(g, w, threads, struct graph_worker_s);
+    graph_mem_free(g, t, threads, pthread_t);
+
+    return reached ? reached : graph_bfs(g, source, dist);
+}
+
+/*
+ * size_t graph_dfs(const struct graph_s *g, size_t source, size_t *order)
+ *  Depth-first search from source, following each vertex's edges in
+ *  order and setting order[v] to the number of vertices reached before
+ *  v (so order[source] is 0).
+ *
+ * output:
+ *  size_t - the number of vertices reached, including source.
+ */
+size_t graph_dfs(const struct graph_s *g, size_t source, size_t *order)
+{
+    if(!g || !order || source >= g->nverts)
+        return 0;
+
+    /*
+     * For each vertex on the stack, the position of the next edge to
+     * follow from it.
+     */
+    size_t *stack = graph_mem_alloc(g, g->nverts, size_t),
+        *edge = graph_mem_alloc(g, g->nverts, size_t),
+        depth = 0, reached = 0, v;
+
+    if(!stack || !edge) {
+        graph_mem_free(g, stack, g->nverts, size_t);
+        graph_mem_free(g, edge, g->nverts, size_t);
+        return 0;
+    }
+
+    for(v = 0; v < g->nverts; v++)
+        order[v] = GRAPH_NONE;
+
+    order[source] = reached++;
+    stack[depth] = source;
+    edge[depth++] = g->offsets[source];
+
+    while(depth) {
+        v = stack[depth - 1];
+
+        if(edge[depth - 1] == g->offsets[v + 1]) {
+            depth--;
+            continue;
+        }
+
+        v = g->targets[edge[depth - 1]++];
+
+        if(order[v] == GRAPH_NONE) {
+            order[v] = reached++;
+            stack[depth] = v;
+            edge[depth++] = g->offsets[v];
+        }
+    }
+
+    graph_mem_free(g, stack, g->nverts, size_t);
+    graph_mem_free(g, edge, g->nverts, size_t);
+
+    return reached;
+}
+
+/*
+ * size_t graph_components(const struct graph_s *g, size_t *comp)
+ *  Find the graph's connected components, ignoring the direction of its
+ *  edges, and set comp[v] to the component of each vertex v. Components
+ *  are numbered from 0 in the order of their first vertex.
+ *
+ * output:
+ *  size_t - the number of components.
+ */
+size_t graph_components(const struct graph_s *g, size_t *comp)
+{
+    if(!g || !comp)
+        return 0;
+
+    size_t *parent = graph_mem_alloc(g, g->nverts + 1, size_t),
+        count = 0, v, a, b, *e, *end;
+
+    if(!parent)
+        return 0;
+
+    for(v = 0; v < g->nverts; v++)
+        parent[v] = v;
+
+    /*
+     * Always hang the later root off the earlier one, so every root is
+     * the first vertex of its component.
+     */
+    for(v = 0; v < g->nverts; v++) {
+        e = graph_neighbors(g, v);
+        end = e + graph_degree(g, v);
+
+        for(; e < end; e++) {
+            a = graph_find(parent, v);
+            b = graph_find(parent, *e);
+
+            if(a < b)
+                parent[b] = a;
+            else if(b < a)
+                parent[a] = b;
+        }
+    }
+
+    for(v = 0; v < g->nverts; v++)
+        comp[v] = (a = graph_find(parent, v)) == v ? count++ : comp[a];
+
+    graph_mem_free(g, parent, g->nverts + 1, size_t);
+
+    return count;
+}
+
+/*
+ * size_t graph_dijkstra(const struct graph_s *g, size_t source, double *dist,
+ *  size_t *prev)
+ *  Find the shortest paths from source to every vertex, setting dist[v]
+ *  to the length of the shortest path to v (INFINITY if there is none)
+ *  and prev[v] to the vertex before v on it (GRAPH_NONE for source and
+ *  the vertices which weren't reached). prev may be 0.
+ *
+ * output:
+ *  size_t - the number of vertices reached, including source.
+ */
+size_t graph_dijkstra(const struct graph_s *g, size_t source, double *dist,
+    size_t *prev)
+{
+    if(!g || !dist || source >= g->nverts)
+        return 0;
+
+    return graph_search(g, source, GRAPH_NONE, 0, 0, dist, prev);
+}
+
+/*
+ * size_t graph_astar(const struct graph_s *g, size_t source, size_t target,
+ *  double (*h)(const struct node_s *, const struct node_s *, void *),
+ *  void *ctx, size_t *path, double *cost)
+ *  Find the shortest path from source to target. h(v, t, ctx), if given,
+ *  estimates the distance from vertex node v to the target vertex node t
+ *  and must never overestimate it.
+ *
+ * inputs:
+ *  path - filled with the vertices along the path, from source to target.
+ *  It needs room for as many vertices as there are in the graph.
+ *  cost - set to the length of the path, unless it's 0.
+ *
+ * output:
+ *  size_t - the number of vertices on the path, or 0 if target can't be
+ *  reached from source.
+ */
+size_t graph_astar(const struct graph_s *g, size_t source, size_t target,
+    double (*h)(const struct node_s *, const struct node_s *, void *),
+    void *ctx, size_t *path, double *cost)
+{
+    if(!g || !path || source >= g->nverts || target >= g->nverts)
+        return 0;
+
+    double *dist = graph_mem_alloc(g, g->nverts, double);
+    size_t *prev = graph_mem_alloc(g, g->nverts, size_t),
+        len = 0, v, i;
+
+    if(dist && prev && graph_search(g, source, target, h, ctx, dist, prev) &&
+        dist[target] != INFINITY) {
+        for(v = target; v != GRAPH_NONE; v = prev[v])
+            len++;
+
+        for(v = target, i = len; v != GRAPH_NONE; v = prev[v])
+            path[--i] = v;
+
+        if(cost)
+            *cost = dist[target];
+    }
+
+    graph_mem_free(g, dist, g->nverts, double);
+    graph_mem_free(g, prev, g->nverts, size_t);
+
+    return len;
+}
+
+/*
+ * size_t node_graph_path(const struct graph_s *g, const struct node_s *from,
+ *  const struct node_s *to,
+ *  double (*h)(const struct node_s *, const struct node_s *, void *),
+ *  void *ctx, struct node_s **path, double *cost)
+ *  The same as graph_astar, taking and giving vertex nodes rather than
+ *  indices. from and to must be vertices of the graph g was frozen from,
+ *  and path needs room for g->nverts vertex nodes.
+ *
+ * notes:
+ *  - The snapshot is reused, so each search costs what graph_astar's
+ *    does: O(V) to set up, plus the search itself. Freezing, which
+ *    takes O(V + E), happens once, whenever the caller chooses to.
+ */
+size_t node_graph_path(const struct graph_s *g, const struct node_s *from,
+    const struct node_s *to,
+    double (*h)(const struct node_s *, const struct node_s *, void *),
+    void *ctx, struct node_s **path, double *cost)
+{
+    if(!g || !from || !to || !path || from->id >= g->nverts ||
+        to->id >= g->nverts || g->verts[from->id] != from ||
+        g->verts[to->id] != to)
+        return 0;
+
+    size_t *p = graph_mem_alloc(g, g->nverts, size_t), len = 0, i;
+
+    if(p && (len = graph_astar(g, from->id, to->id, h, ctx, p, cost)))
+        for(i = 0; i < len; i++)
+            path[i] = g->verts[p[i]];
+
+    graph_mem_free(g, p, g->nverts, size_t);
+
+    return len;
+}
@@ -0,0 +1,552 @@
+/*
+ * import.c
+ *
+ * Building graphs and maps from text files.
+ *
+ * The file is read IMPORT_CHUNK bytes at a time into one buffer, and
+ * lines are cut out of it in place: the separators and line ends are
+ * overwritten with terminators, so that fields can be handed to strtod
+ * or copied into string nodes without going through a line buffer. A
+ * line which runs past the end of the buffer is moved to the front
+ * before the next chunk is read in behind it.
+ *
+ * Vertices are found by label through an open addressing index of the
+ * vertex nodes, which compares labels against the vertices' own strings,
+ * so no label is stored twice. Each slot keeps its label's hash next to
+ * the vertex, so that a lookup usually touches just the slot and the
+ * vertex it's after, and growing the index doesn't mean hashing the
+ * labels again.
+ */
+#include "common.h"
+
+#define IMPORT_CHUNK (1 << 20)
+#define IMPORT_MIN 64
+#define IMPORT_FIELDS 3
+
+struct import_field_s {
+    char *s;
+    size_t len;
+};
+
+struct import_reader_s {
+    FILE *f;
+    char *buf;
+    size_t size, len, pos;
+    bool eof, error;
+};
+
+struct import_slot_s {
+    size_t hash;
+    struct node_s *n;
+};
+
+/*
+ * The state of a graph import. degree, when presizing, counts the edges
+ * each vertex will have.
+ */
+struct import_s {
+    const struct node_import_s *o;
+    struct node_s *g;
+    struct import_slot_s *slots;
+    size_t *degree, max, ndegree;
+};
+
+/*
+ * static functions
+ */
+
+static bool import_open(struct import_reader_s *r, const char *path)
+{
+    memset(r, 0, sizeof(*r));
+
+    if(!path || !(r->f = fopen(path, "rb")))
+        return false;
+
+    r->size = IMPORT_CHUNK;
+    if(!(r->buf = (char *) malloc(r->size + 1))) {
+        fclose(r->f);
+        return false;
+    }
+
+    return true;
+}
+
+static void import_close(struct import_reader_s *r)
+{
+    fclose(r->f);
+    free(r->buf);
+}
+
+/*
+ * static bool import_rewind(struct import_reader_s *r)
+ * Go back to the start of the file for another pass.
+ */
+static bool import_rewind(struct import_reader_s *r)
+{
+    r->len = r->pos = 0;
+    r->eof = false;
+
+    return !fseek(r->f, 0, SEEK_SET);
+}
+
+/*
+ * static char *import_line(struct import_reader_s *r, size_t *len)
+ * Get the next line, without its line end and terminated in its place.
+ *
+ * output:
+ *  char * - the line, valid until the next call, or 0 at the end of the
+ *  file or if it couldn't be read (in which case r->error is set).
+ */
+static char *import_line(struct import_reader_s *r, size_t *len)
+{
+    char *line, *end;
+    size_t n;
+
+    for(;;) {
+        line = r->buf + r->pos;
+
+        if((end = (char *) memchr(line, '\n', r->len - r->pos))) {
+            r->pos = end - r->buf + 1;
+            break;
+        }
+
+        /*
+         * The last line needn't end with a line end. The buffer always
+         * has a byte to spare for its terminator.
+         */
+        if(r->eof) {
+            if(r->pos == r->len)
+                return 0;
+
+            end = r->buf + r->len;
+            r->pos = r->len;
+            break;
+        }
+
+        /*
+         * Keep what's left of the current line and read more after it,
+         * making room if the line fills the whole buffer.
+         */
+        n = r->len - r->pos;
+        memmove(r->buf, line, n);
+        r->pos = 0;
+        r->len = n;
+
+        if(n == r->size) {
+            char *buf = (char *) realloc(r->buf, (r->size << 1) + 1);
+            if(!buf) {
+                r->error = true;
+                return 0;
+            }
+
+            r->buf = buf;
+            r->size <<= 1;
+        }
+
+        r->len += fread(r->buf + n, 1, r->size - n, r->f);
+        if(r->len < r->size) {
+            r->eof = true;
+            if(ferror(r->f)) {
+                r->error = true;
+                return 0;
+            }
+        }
+    }
+
+    if(end > line && end[-1] == '\r')
+        end--;
+
+    *end = 0;
+    *len = end - line;
+
+    return line;
+}
+
+/*
+ * static size_t import_split(char *line, size_t len, char sep,
+ *  struct import_field_s *fields, size_t n)
+ * Cut a line into at most n fields, terminating each of them.
+ *
+ * output:
+ *  size_t - the number of fields found, or 0 for lines to be skipped.
+ */
+static size_t import_split(char *line, size_t len, char sep,
+    struct import_field_s *fields, size_t n)
+{
+    char *end = line + len, *p = line;
+    size_t i;
+
+    if(!len || *line == '#')
+        return 0;
+
+    for(i = 0; i < n && p < end; i++) {
+        if(!sep) {
+            while(p < end && (*p == ' ' || *p == '\t'))
+                p++;
+
+            if(p == end)
+                break;
+
+            fields[i].s = p;
+            while(p < end && *p != ' ' && *p != '\t')
+                p++;
+        } else {
+            fields[i].s = p;
+            if(i == n - 1 || !(p = (char *) memchr(p, sep, end - p)))
+                p = end;
+        }
+
+        fields[i].len = p - fields[i].s;
+        if(!fields[i].len)
+            return 0;
+
+        if(p < end)
+            *p++ = 0;
+    }
+
+    return i;
+}
+
+/*
+ * static struct node_s *import_str(const struct node_import_s *o,
+ *  const struct import_field_s *f)
+ * Make a string node out of a field. Fields short enough to be stored
+ * inline aren't worth interning, so they're never asked to be.
+ */
+static struct node_s *import_str(const struct node_import_s *o,
+    const struct import_field_s *f)
+{
+    return node_new(node_type_str, o->intern && f->len >= STR_SSO_SIZE ?
+        str_init_interned(f->s, f->len) : str_init(f->s, f->len), true);
+}
+
+/*
+ * static bool import_grow(struct import_s *im)
+ * Double the label index.
+ */
+static bool import_grow(struct import_s *im)
+{
+    size_t max = im->max ? im->max << 1 : IMPORT_MIN, i, j;
+    struct import_slot_s *slots = (struct import_slot_s *)
+        calloc(max, sizeof(*slots));
+
+    if(!slots)
+        return false;
+
+    for(i = 0; i < im->max; i++) {
+        if(im->slots[i].n) {
+            for(j = im->slots[i].hash & (max - 1); slots[j].n;
+                j = (j + 1) & (max - 1))
+                ;
+
+            slots[j] = im->slots[i];
+        }
+    }
+
+    free(im->slots);
+    im->slots = slots;
+    im->max = max;
+
+    return true;
+}
+
+/*
+ * static struct node_s *import_vertex(struct import_s *im,
+ *  const struct import_field_s *f)
+ * Find the vertex with the given label, adding it if there isn't one.
+ *
+ * output:
+ *  struct node_s * - the vertex, or 0 if there wasn't enough memory.
+ */
+static struct node_s *import_vertex(struct import_s *im,
+    const struct import_field_s *f)
+{
+    size_t hash = str_hash_buf(f->s, f->len), i;
+    struct node_s *n;
+
+    if((im->g->len + 1) * 2 > im->max && !import_grow(im))
+        return 0;
+
+    for(i = hash & (im->max - 1); (n = im->slots[i].n);
+        i = (i + 1) & (im->max - 1)) {
+        if(im->slots[i].hash == hash && str_node_len(n) == f->len &&
+            !memcmp(str_node_buf(n), f->s, f->len))
+            return n;
+    }
+
+    if(!(n = import_str(im->o, f)))
+        return 0;
+
+    if(!node_push(im->g, n)) {
+        node_free_all(n);
+        return 0;
+    }
+
+    im->slots[i].hash = hash;
+    im->slots[i].n = n;
+
+    return n;
+}
+
+/*
+ * static bool import_edge(struct node_s *from, struct node_s *to,
+ *  const struct import_field_s *weight)
+ * Add an edge, weighted or not, between two vertices.
+ */
+static bool import_edge(struct node_s *from, struct node_s *to,
+    const struct import_field_s *weight)
+{
+    struct node_s *e = weight ? edge_node_new(to, strtod(weight->s, 0)) :
+        node_new_node_const(to);
+
+    if(e && node_push(from, e))
+        return true;
+
+    node_free_one(e);
+    return false;
+}
+
+/*
+ * static bool import_fields(const struct node_import_s *o,
+ *  struct import_field_s *f, size_t n)
+ * Check that an edge line has everything it needs.
+ */
+static bool import_fields(const struct node_import_s *o,
+    struct import_field_s *f, size_t n)
+{
+    char *end;
+
+    if(n < (o->weighted ? 3 : 2))
+        return false;
+
+    if(o->weighted) {
+        strtod(f[2].s, &end);
+        return end != f[2].s && !*end;
+    }
+
+    return true;
+}
+
+/*
+ * static bool import_presize(struct import_s *im, struct import_reader_s *r)
+ * Make a first pass over an edge list, adding every vertex and counting
+ * its edges, then reserve room in each vertex's table for them.
+ */
+static bool import_presize(struct import_s *im, struct import_reader_s *r)
+{
+    struct import_field_s f[IMPORT_FIELDS];
+    struct node_s *a, *b;
+    size_t len, n, i;
+    char *line;
+
+    while((line = import_line(r, &len))) {
+        n = import_split(line, len, im->o->sep, f, IMPORT_FIELDS);
+        if(!import_fields(im->o, f, n))
+            continue;
+
+        if(!(a = import_vertex(im, &f[0])) || !(b = import_vertex(im, &f[1])))
+            return false;
+
+        /*
+         * degree grows along with the vertices, which are numbered by
+         * their id in the graph.
+         */
+        if(im->g->len > im->ndegree) {
+            size_t ndegree = im->ndegree ? im->ndegree << 1 : IMPORT_MIN;
+            size_t *degree = (size_t *) realloc(im->degree,
+                sizeof(size_t) * ndegree);
+
+            if(!degree)
+                return false;
+
+            memset(degree + im->ndegree, 0,
+                sizeof(size_t) * (ndegree - im->ndegree));
+            im->degree = degree;
+            im->ndegree = ndegree;
+        }
+
+        im->degree[a->id]++;
+        if(im->o->undirected && a != b)
+            im->degree[b->id]++;
+    }
+
+    for(i = 0; i < im->g->len; i++)
+        if(im->degree[i] && node_reserve(im->g->table[i], im->degree[i]) <
+            im->degree[i])
+            return false;
+
+    return !r->error && import_rewind(r);
+}
+
+/*
+ * non-static functions
+ */
+
+/*
+ * struct node_s *node_import_graph(const char *path,
+ *  const struct node_import_s *o)
+ *  Build a graph from an edge list. See import.h for the file's format
+ *  and the options.
+ *
+ * output:
+ *  struct node_s * - the graph, a string node holding path whose
+ *  children are the vertices, or 0 if the file couldn't be read or
+ *  there wasn't enough memory.
+ */
+struct node_s *node_import_graph(const char *path,
+    const struct node_import_s *o)
+{
+    const struct node_import_s defaults = { 0 };
+    struct import_reader_s r;
+    struct import_field_s f[IMPORT_FIELDS];
+    struct import_s im = { .o = o ? o : &defaults };
+    struct node_s *a, *b;
+    size_t len, n, i, degree;
+    bool ok = true;
+    char *line;
+
+    if(!import_open(&r, path))
+        return 0;
+
+    o = im.o;
+    if(!(im.g = str_node_new(path))) {
+        import_close(&r);
+        return 0;
+    }
+
+    /*
+     * Size things up from the hints, unless the first pass is going to
+     * tell us exactly.
+     */
+    if(o->presize) {
+        ok = import_presize(&im, &r);
+    } else if(o->vertices) {
+        ok = node_reserve(im.g, o->vertices) >= o->vertices;
+        while(ok && im.max < o->vertices * 2)
+            ok = import_grow(&im);
+    }
+
+    degree = !o->presize && o->vertices ? (o->edges *
+        (o->undirected ? 2 : 1) + o->vertices - 1) / o->vertices : 0;
+
+    while(ok && (line = import_line(&r, &len))) {
+        n = import_split(line, len, o->sep, f, IMPORT_FIELDS);
+        if(!import_fields(o, f, n))
+            continue;
+
+        i = im.g->len;
+        if(!(a = import_vertex(&im, &f[0])) ||
+            !(b = import_vertex(&im, &f[1]))) {
+            ok = false;
+            break;
+        }
+
+        /*
+         * New vertices get room for the average number of edges.
+         */
+        for(; degree && i < im.g->len; i++)
+            node_reserve(im.g->table[i], degree);
+
+        ok = import_edge(a, b, o->weighted ? &f[2] : 0) &&
+            (!o->undirected || a == b ||
+            import_edge(b, a, o->weighted ? &f[2] : 0));
+    }
+
+    ok = ok && !r.error;
+
+    import_close(&r);
+    free(im.slots);
+    free(im.degree);
+
+    if(!ok) {
+        node_free_all(im.g);
+        return 0;
+    }
+
+    return im.g;
+}
+
+/*
+ * struct node_s *node_import_map(const char *path,
+ *  const struct node_import_s *o)
+ *  Build a map from a file of keys and values. See import.h for the
+ *  file's format and the options, of which only sep, intern, presize and
+ *  vertices (the expected number of keys) apply.
+ *
+ * output:
+ *  struct node_s * - the map, or 0 if the file couldn't be read or there
+ *  wasn't enough memory.
+ */
+struct node_s *node_import_map(const char *path,
+    const struct node_import_s *o)
+{
+    const struct node_import_s defaults = { 0 };
+    struct import_reader_s r;
+    struct import_field_s f[2];
+    struct node_s *m, *k, *v;
+    size_t len, keys = 0;
+    bool ok = true;
+    char *line;
+
+    if(!import_open(&r, path))
+        return 0;
+
+    if(!o)
+        o = &defaults;
+
+    if(!(m = map_node_new())) {
+        import_close(&r);
+        return 0;
+    }
+
+    if(o->presize) {
+        while((line = import_line(&r, &len)))
+            keys += import_split(line, len, o->sep, f, 2) == 2;
+
+        ok = !r.error && import_rewind(&r);
+    } else {
+        keys = o->vertices;
+    }
+
+    /*
+     * Size the index along with the table, so that neither one grows
+     * and the index is never rehashed while importing.
+     */
+    ok = ok && node_map_reserve(m, keys);
+
+    while(ok && (line = import_line(&r, &len))) {
+        if(import_split(line, len, o->sep, f, 2) != 2)
+            continue;
+
+        k = import_str(o, &f[0]);
+        v = import_str(o, &f[1]);
+
+        if(!k || !v || !node_put(k, NODE_NEXT, v)) {
+            node_free_all(k);
+            node_free_all(v);
+            ok = false;
+            break;
+        }
+
+        /*
+         * Whatever the key replaced goes, along with its value.
+         */
+        if((v = node_map_put(m, k)) == k) {
+            node_free_all(k);
+            ok = false;
+            break;
+        }
+
+        node_free_all(v);
+    }
+
+    ok = ok && !r.error;
+    import_close(&r);
+
+    if(!ok) {
+        node_free_all(m);
+        return 0;
+    }
+
+    return m;
+}
@@ -1,41 +1,73 @@
 #include "common.h"
 
-static void int_free(void *data)
+static bool int_set(void *data, const void *init,
+    const struct node_allocator_s *a)
 {
-    if(!data)
-        return;
+    int_get_n(data) = *(int *) init;
+    return true;
+}
 
-    free(data);
+static int int_diff(const void *a, const void *b)
+{
+    return int_data_diff(a, b);
 }
 
-static void *int_new(const void *init)
+/*
+ * The splitmix64 finalizer, so that consecutive integers don't end up
+ * in consecutive slots of a hash table.
+ */
+static size_t int_hash(const void *d)
 {
-    struct int_s *new = (struct int_s *) malloc(sizeof(struct int_s));
-    if(!new)
-        return 0;
+    uint64_t h = (uint64_t) (int64_t) int_get_n(d);
+
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
 
-    new->n = *(int *) init;
-    return (void *) new;
+    return (size_t) (h ^ (h >> 31));
 }
 
-static int int_diff(const void *a, const void *b)
+/*
+ * Integers are saved as they are in memory.
+ */
+static size_t int_serialize(const void *d, void *buf, size_t size)
+{
+    if(size >= sizeof(int))
+        memcpy(buf, &int_get_n(d), sizeof(int));
+
+    return sizeof(int);
+}
+
+static bool int_deserialize(void *data, const void *buf, size_t size,
+    const struct node_allocator_s *a)
+{
+    if(size != sizeof(int))
+        return false;
+
+    memcpy(&int_get_n(data), buf, sizeof(int));
+    return true;
+}
+
+static int int_print(const void *d, char *buf, size_t size)
 {
-    return int_get_n(a) - int_get_n(b);
+    return snprintf(buf, size, "%d", int_get_n(d));
 }
 
 static struct node_s *int_to_str(const void *d)
 {
     char s[100];
-    snprintf(s, 100, "%d", int_get_n(d));
+    int_print(d, s, sizeof(s));
     return str_node_new(s);
 }
 
 static const struct node_type_s _type_int = {
     .size = sizeof(struct int_s),
-    .freev = int_free,
-    .new = int_new,
+    .init = int_set,
     .diff = int_diff,
+    .hash = int_hash,
     .to_str = int_to_str,
+    .print = int_print,
+    .serialize = int_serialize,
+    .deserialize = int_deserialize,
     .name = "integer"
 };
 
@@ -0,0 +1,257 @@
+/*
+ * lfq.c
+ *
+ * Bounded lock-free queues of node pointers.
+ *
+ * The multi-producer/multi-consumer queue is Dmitry Vyukov's bounded
+ * queue: every cell carries a sequence number which tells producers
+ * and consumers whether it is their turn to use it. Producers claim
+ * cells by advancing the tail with a compare-and-swap and consumers do
+ * the same with the head, so contention is limited to those two
+ * counters, which live on separate cache lines.
+ *
+ * The single-producer/single-consumer queue needs no compare-and-swap
+ * at all. Each side owns one counter and keeps a cached copy of the
+ * other's, which it only refreshes when the queue looks full (or empty).
+ */
+#include "common.h"
+
+/*
+ * static size_t lfq_size(size_t size)
+ * Round the requested capacity up to a power of two.
+ */
+static size_t lfq_size(size_t size)
+{
+    size_t n = 2;
+
+    while(n < size)
+        n <<= 1;
+
+    return n;
+}
+
+/*
+ * struct lfq_s *lfq_new(size_t size)
+ *  Create a queue with room for at least size items.
+ */
+struct lfq_s *lfq_new(size_t size)
+{
+    struct lfq_s *q = (struct lfq_s *)
+        aligned_alloc(LFQ_CACHE_LINE, sizeof(struct lfq_s));
+    if(!q)
+        return 0;
+
+    size = lfq_size(size);
+    if(!(q->cells = (struct lfq_cell_s *)
+        malloc(sizeof(struct lfq_cell_s) * size))) {
+        free(q);
+        return 0;
+    }
+
+    size_t i;
+    for(i = 0; i < size; i++) {
+        atomic_init(&q->cells[i].seq, i);
+        q->cells[i].n = 0;
+    }
+
+    q->mask = size - 1;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+
+    return q;
+}
+
+/*
+ * void lfq_free(struct lfq_s *q)
+ *  Free the queue. Whatever nodes are still in it are left alone.
+ */
+void lfq_free(struct lfq_s *q)
+{
+    if(!q)
+        return;
+
+    free(q->cells);
+    free(q);
+}
+
+/*
+ * bool lfq_en(struct lfq_s *q, struct node_s *n)
+ *  Add a node to the back of the queue.
+ *
+ * output:
+ *  bool - false if the queue was full.
+ */
+bool lfq_en(struct lfq_s *q, struct node_s *n)
+{
+    if(!q || !n)
+        return false;
+
+    struct lfq_cell_s *c;
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed), seq;
+
+    for(;;) {
+        c = &q->cells[pos & q->mask];
+        seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+
+        /*
+         * The cell is free for this position: try to claim it.
+         */
+        if(seq == pos) {
+            if(atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed))
+                break;
+
+        /*
+         * The cell still holds an item from the previous lap.
+         */
+        } else if((ptrdiff_t) (seq - pos) < 0) {
+            return false;
+
+        /*
+         * Somebody else claimed it first.
+         */
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+
+    c->n = n;
+    atomic_store_explicit(&c->seq, pos + 1, memory_order_release);
+
+    return true;
+}
+
+/*
+ * struct node_s *lfq_de(struct lfq_s *q)
+ *  Take a node from the front of the queue.
+ *
+ * output:
+ *  struct node_s * - the node, or 0 if the queue was empty.
+ */
+struct node_s *lfq_de(struct lfq_s *q)
+{
+    if(!q)
+        return 0;
+
+    struct lfq_cell_s *c;
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed), seq;
+
+    for(;;) {
+        c = &q->cells[pos & q->mask];
+        seq = atomic_load_explicit(&c->seq, memory_order_acquire);
+
+        if(seq == pos + 1) {
+            if(atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1,
+                memory_order_relaxed, memory_order_relaxed))
+                break;
+
+        /*
+         * Nothing has been written to the cell yet.
+         */
+        } else if((ptrdiff_t) (seq - (pos + 1)) < 0) {
+            return 0;
+
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+
+    struct node_s *n = c->n;
+
+    /*
+     * Hand the cell over to the producer of the next lap.
+     */
+    atomic_store_explicit(&c->seq, pos + q->mask + 1, memory_order_release);
+
+    return n;
+}
+
+/*
+ * struct spsc_s *spsc_new(size_t size)
+ *  Create a single-producer/single-consumer queue with room for at least
+ *  size items.
+ */
+struct spsc_s *spsc_new(size_t size)
+{
+    struct spsc_s *q = (struct spsc_s *)
+        aligned_alloc(LFQ_CACHE_LINE, sizeof(struct spsc_s));
+    if(!q)
+        return 0;
+
+    size = lfq_size(size);
+    if(!(q->buf = (struct node_s **) malloc(sizeof(struct node_s *) * size))) {
+        free(q);
+        return 0;
+    }
+
+    q->mask = size - 1;
+    q->head_cache = 0;
+    q->tail_cache = 0;
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->head, 0);
+
+    return q;
+}
+
+void spsc_free(struct spsc_s *q)
+{
+    if(!q)
+        return;
+
+    free(q->buf);
+    free(q);
+}
+
+/*
+ * bool spsc_en(struct spsc_s *q, struct node_s *n)
+ *  Add a node to the back of the queue. Only call this from the
+ *  producer thread.
+ *
+ * output:
+ *  bool - false if the queue was full.
+ */
+bool spsc_en(struct spsc_s *q, struct node_s *n)
+{
+    if(!q || !n)
+        return false;
+
+    size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    if(tail - q->head_cache > q->mask) {
+        q->head_cache = atomic_load_explicit(&q->head, memory_order_acquire);
+        if(tail - q->head_cache > q->mask)
+            return false;
+    }
+
+    q->buf[tail & q->mask] = n;
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+/*
+ * struct node_s *spsc_de(struct spsc_s *q)
+ *  Take a node from the front of the queue. Only call this from the
+ *  consumer thread.
+ *
+ * output:
+ *  struct node_s * - the node, or 0 if the queue was empty.
+ */
+struct node_s *spsc_de(struct spsc_s *q)
+{
+    if(!q)
+        return 0;
+
+    size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    if(head == q->tail_cache) {
+        q->tail_cache = atomic_load_explicit(&q->tail, memory_order_acquire);
+        if(head == q->tail_cache)
+            return 0;
+    }
+
+    struct node_s *n = q->buf[head & q->mask];
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+    return n;
+}
@@ -0,0 +1,290 @@
+/*
+ * map.c
+ *
+ * A hash map of child nodes.
+ *
+ * The children live in the map node's table, packed together at the
+ * front of it, so that freeing the map frees them along with it. The
+ * map's data is an index of the children: an open addressing hash table
+ * with linear probing, which we keep at most half full. Every slot
+ * remembers its node's hash so that growing the index and deleting from
+ * it never has to call back into the key's type.
+ */
+#include "common.h"
+
+#define MAP_MIN 8
+
+/*
+ * static functions
+ */
+
+static bool map_set(void *data, const void *init,
+    const struct node_allocator_s *a)
+{
+    memset(data, 0, sizeof(struct map_s));
+    return true;
+}
+
+static void map_clear(void *data, const struct node_allocator_s *a)
+{
+    node_mem_free(a, map_get(data)->slots,
+        sizeof(struct map_slot_s) * map_get(data)->max);
+}
+
+static int map_diff(const void *a, const void *b)
+{
+    return (int) map_get(a)->len - (int) map_get(b)->len;
+}
+
+static int map_print(const void *data, char *buf, size_t size)
+{
+    return snprintf(buf, size, "map of %lu", map_get(data)->len);
+}
+
+static struct node_s *map_to_str(const void *data)
+{
+    char s[100];
+    map_print(data, s, sizeof(s));
+    return str_node_new(s);
+}
+
+/*
+ * static size_t map_find(const struct map_s *m, const struct node_s *key,
+ *  size_t hash)
+ * Return the slot holding a node equal to key, or the empty slot where
+ * it belongs. The index must have at least one empty slot.
+ */
+static size_t map_find(const struct map_s *m, const struct node_s *key,
+    size_t hash)
+{
+    size_t mask = m->max - 1, i = hash & mask;
+    struct map_slot_s *s;
+
+    for(; (s = &m->slots[i])->n; i = (i + 1) & mask)
+        if(s->hash == hash && !node_diff(s->n, key))
+            break;
+
+    return i;
+}
+
+/*
+ * static bool map_grow(const struct node_allocator_s *a, struct map_s *m,
+ *  size_t max)
+ * Rehash the index into max slots, a power of two larger than the
+ * index has now.
+ */
+static bool map_grow(const struct node_allocator_s *a, struct map_s *m,
+    size_t max)
+{
+    size_t i, j, old_max = m->max;
+    struct map_slot_s *old = m->slots,
+        *slots = (struct map_slot_s *) node_mem_alloc(a, sizeof(*slots) * max);
+    if(!slots)
+        return false;
+
+    memset(slots, 0, sizeof(*slots) * max);
+
+    m->slots = slots;
+    m->max = max;
+
+    /*
+     * The old entries are all distinct, so each one goes in the first
+     * empty slot we find for it.
+     */
+    for(i = 0; old && i < old_max; i++) {
+        if(!old[i].n)
+            continue;
+
+        for(j = old[i].hash & (max - 1); slots[j].n; j = (j + 1) & (max - 1))
+            ;
+
+        slots[j] = old[i];
+    }
+
+    node_mem_free(a, old, sizeof(*slots) * old_max);
+    return true;
+}
+
+/*
+ * static void map_unindex(struct map_s *m, size_t i)
+ * Empty slot i, using backward shift deletion: move up any entries
+ * which would no longer be reachable once the slot is empty.
+ */
+static void map_unindex(struct map_s *m, size_t i)
+{
+    size_t mask = m->max - 1, j, k;
+
+    for(j = (i + 1) & mask; m->slots[j].n; j = (j + 1) & mask) {
+        k = m->slots[j].hash & mask;
+        if((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            m->slots[i] = m->slots[j];
+            i = j;
+        }
+    }
+
+    m->slots[i].n = 0;
+    m->len--;
+}
+
+/*
+ * static bool map_usable(const struct node_s *map, const struct node_s *key)
+ * Check that we have a map and a key we can hash.
+ */
+static bool map_usable(const struct node_s *map, const struct node_s *key)
+{
+    return map && key && (map->type == node_type_map) && key->type->hash;
+}
+
+/*
+ * non-static functions
+ */
+
+/*
+ * struct node_s *node_map_get(const struct node_s *map,
+ *  const struct node_s *key)
+ *  Find the child of map which is equal to key.
+ *
+ * output:
+ *  struct node_s * - the child, or 0 if there isn't one.
+ */
+struct node_s *node_map_get(const struct node_s *map, const struct node_s *key)
+{
+    if(!map_usable(map, key))
+        return 0;
+
+    const struct map_s *m = map_get(map->data);
+    if(!m->len)
+        return 0;
+
+    return m->slots[map_find(m, key, node_hash(key))].n;
+}
+
+/*
+ * struct node_s *node_map_put(struct node_s *map, struct node_s *n)
+ *  Add n to the map, replacing any child equal to it.
+ *
+ * inputs:
+ *  struct node_s *map - the map.
+ *  struct node_s *n - the new child. If it has an owner, it is released
+ *  from it first. Shared nodes can't be added.
+ *
+ * output:
+ *  struct node_s * - the child n replaced, now without an owner and
+ *  yours to free, or 0 if there wasn't one. If n could not be added
+ *  at all, n itself.
+ */
+struct node_s *node_map_put(struct node_s *map, struct node_s *n)
+{
+    if(!map_usable(map, n) || node_shared(n))
+        return n;
+
+    /*
+     * n is already in the map.
+     */
+    if(n->owner == map)
+        return 0;
+
+    struct map_s *m = map_get(map->data);
+
+    /*
+     * Keep the index at most half full.
+     */
+    if((m->len + 1) << 1 > m->max && !map_grow(map->alloc, m,
+        m->max ? m->max << 1 : MAP_MIN))
+        return n;
+
+    size_t hash = node_hash(n), i = map_find(m, n, hash);
+    struct node_s *old = m->slots[i].n;
+
+    /*
+     * n takes over the replaced child's place in the table.
+     */
+    if(!node_put(map, old ? old->id : map->len, n))
+        return n;
+
+    m->slots[i].hash = hash;
+    m->slots[i].n = n;
+
+    if(!old)
+        m->len++;
+
+    return old;
+}
+
+/*
+ * bool node_map_reserve(struct node_s *map, size_t n)
+ *  Make room for n children in both the map's table and its index, so
+ *  that adding them won't have to grow either one.
+ *
+ * output:
+ *  bool - false if map isn't a map or there wasn't enough memory.
+ */
+bool node_map_reserve(struct node_s *map, size_t n)
+{
+    if(!map || map->type != node_type_map)
+        return false;
+
+    struct map_s *m = map_get(map->data);
+    size_t max = MAP_MIN;
+
+    while(max < n << 1)
+        max <<= 1;
+
+    if(max > m->max && !map_grow(map->alloc, m, max))
+        return false;
+
+    return node_reserve(map, n) >= n;
+}
+
+/*
+ * struct node_s *node_map_remove(struct node_s *map,
+ *  const struct node_s *key)
+ *  Remove the child of map which is equal to key.
+ *
+ * output:
+ *  struct node_s * - the child, now without an owner and yours to free,
+ *  or 0 if there wasn't one.
+ */
+struct node_s *node_map_remove(struct node_s *map, const struct node_s *key)
+{
+    if(!map_usable(map, key))
+        return 0;
+
+    struct map_s *m = map_get(map->data);
+    if(!m->len)
+        return 0;
+
+    size_t i = map_find(m, key, node_hash(key));
+    struct node_s *n = m->slots[i].n;
+    if(!n)
+        return 0;
+
+    map_unindex(m, i);
+
+    /*
+     * Fill the hole n leaves in the table with the last child, unless
+     * n was the last child itself.
+     */
+    i = n->id;
+    node_release(map, i);
+
+    if(i < map->len)
+        node_set(map, i, node_release(map, map->len - 1));
+
+    return n;
+}
+
+/*
+ * The map type
+ */
+static const struct node_type_s _type_map = {
+    .size = sizeof(struct map_s),
+    .init = map_set,
+    .fini = map_clear,
+    .diff = map_diff,
+    .to_str = map_to_str,
+    .print = map_print,
+    .name = "map"
+};
+
+const struct node_type_s *node_type_map = &_type_map;
@@ -30,10 +30,71 @@
 #define node_clear_table(n, from, to) \
     memset((n)->table + (from), 0, (to) * sizeof(struct node_s *))
 
+/*
+ * Keep the fields traversals read in the node's first cache line.
+ */
+_Static_assert(offsetof(struct node_s, inline_data) + NODE_INLINE_SIZE <=
+    NODE_HOT_SIZE, "struct node_s hot fields don't fit in NODE_HOT_SIZE");
+
+/*
+ * Table growth policies. The default doubles tables as they fill up and
+ * halves them when they drop to a quarter full.
+ */
+const struct node_policy_s node_policy_default = { 0, 2, 4 };
+const struct node_policy_s node_policy_keep = { 0, 2, 0 };
+
+/*
+ * The allocator for new nodes: the calling thread's if it has chosen one,
+ * the process-wide one otherwise.
+ */
+static const struct node_allocator_s *node_allocator_global = &node_allocator_heap;
+static _Thread_local const struct node_allocator_s *node_allocator_thread;
+
+/*
+ * Counts of the node memory allocated and freed on this thread.
+ */
+static _Thread_local struct node_stats_s node_counts;
+
 /*
  * static functions
  */
 
+static void node_mem_count(long long bytes)
+{
+    node_counts.bytes += bytes;
+    node_counts.peak = MAX(node_counts.peak, node_counts.bytes);
+}
+
+static void *heap_alloc(void *ctx, size_t size)
+{
+    return malloc(size);
+}
+
+static void *heap_realloc(void *ctx, void *p, size_t old, size_t size)
+{
+    return realloc(p, size);
+}
+
+static void heap_free(void *ctx, void *p, size_t size)
+{
+    free(p);
+}
+
+static void *node_pool_alloc(void *ctx, size_t size)
+{
+    return pool_alloc(size);
+}
+
+static void *node_pool_realloc(void *ctx, void *p, size_t old, size_t size)
+{
+    return pool_realloc(p, old, size);
+}
+
+static void node_pool_free(void *ctx, void *p, size_t size)
+{
+    pool_free(p, size);
+}
+
 static void _node_free(void *d)
 {
     node_free_all((struct node_s *) d);
@@ -56,17 +117,14 @@ static struct node_s *to_str(const void *data)
 }
 
 /*
- * static void node_free_table(struct node_s *n, bool recurse);
- * Frees all child elements.
+ * static void node_free_table(struct node_s *n);
+ * Frees the table itself. Whatever children are still in it must have
+ * been dealt with already.
  */
-static void node_free_table(struct node_s *n, bool recurse)
+static void node_free_table(struct node_s *n)
 {
-    unsigned i;
-    for(i = 0; i < n->len; i++)
-        node_free(n->table[i], recurse);
-
     pr_dbg("%p (%p)", n->table, n);
-    free(n->table);
+    node_mem_free(n->alloc, n->table, sizeof(struct node_s *) * n->max);
 
     n->table = 0;
     n->len = 0;
@@ -86,7 +144,8 @@ static size_t node_resize_table(struct node_s *n, size_t size)
     pr_dbg("n: %p, n->table: %p, size: %lu", n, n->table, size);
 
     struct node_s **new_table = (struct node_s **)
-        realloc(n->table, sizeof(struct node_s *) * size);
+        node_mem_realloc(n->alloc, n->table,
+            sizeof(struct node_s *) * n->max, sizeof(struct node_s *) * size);
     if(!new_table)
         return 0;
 
@@ -99,11 +158,28 @@ static size_t node_resize_table(struct node_s *n, size_t size)
 }
 
 /*
- * static size_t node_tighten_table(struct node_s *n, bool recurse);
- * Shrink the table if necessary.
+ * static size_t node_grow_table(struct node_s *n, size_t index)
+ * Grow the table so that index fits, according to the node's policy.
+ */
+static size_t node_grow_table(struct node_s *n, size_t index)
+{
+    const struct node_policy_s *p = node_policy(n);
+    size_t size = (index ? index : 1) * (p->grow ? p->grow : 2);
+
+    size = MAX(size, index + 1);
+    size = MAX(size, p->min);
+
+    return node_resize_table(n, size);
+}
+
+/*
+ * static size_t node_tighten_table(struct node_s *n);
+ * Shrink the table if the node's policy says so.
  */
-static size_t node_tighten_table(struct node_s *n, bool recurse)
+static size_t node_tighten_table(struct node_s *n)
 {
+    const struct node_policy_s *p = node_policy(n);
+
     /*
      * If n->max is 0 we cannot tighten any further.
      */
@@ -116,18 +192,38 @@ static size_t node_tighten_table(struct node_s *n, bool recurse)
     for(; n->len && !n->table[n->len - 1]; n->len--)
         ;
 
+    if(!p->shrink)
+        return n->max;
+
     /*
-     * Use a 4 to 2 threshold: if we have 1/4 the elements,
+     * By default, use a 4 to 2 threshold: if we have 1/4 the elements,
      * shrink the table by half.
      */
-    if(!n->len)
-        node_free_table(n, recurse);
-    else if(n->len < (n->max >> 2))
-        node_resize_table(n, n->max >> 1);
+    if(!n->len && !p->min)
+        node_free_table(n);
+    else if(n->len < n->max / p->shrink && n->max > p->min)
+        node_resize_table(n, MAX(n->max / (p->grow ? p->grow : 2), p->min));
 
     return n->max;
 }
 
+/*
+ * Clear the given slot of n's table, which must be in use.
+ */
+static void node_detach(struct node_s *n, size_t index)
+{
+    /*
+     * Remove the child from the table *before* we attempt to tighten it.
+     */
+    n->table[index] = 0;
+
+    /*
+     * Run the tightening operation because we may have cleared
+     * up enough room in the table for it to be worth it.
+     */
+    node_tighten_table(n);
+}
+
 /*
  * Remove the node from its owner's table if an owner exists.
  * Assume that value stored at n->owner is a valid node pointer and
@@ -137,21 +233,12 @@ static void node_emancipate(struct node_s *n)
 {
     /*
      * If we don't belong to anyone, there's nothing for us to do here.
+     * Shared nodes never do.
      */
     if(!n->owner)
         return;
 
-    /*
-     * Remove ourselves from the owner's table *before* we
-     * attempt to tighten it.
-     */
-    n->owner->table[n->id] = 0;
-
-    /*
-     * Run the tightening operation because we may have cleared
-     * up enough room in the owner's table for it to be worth it.
-     */
-    node_tighten_table(n->owner, true);
+    node_detach(n->owner, n->id);
 
     /*
      * Forget the owner and clear our id.
@@ -167,6 +254,16 @@ static void node_emancipate(struct node_s *n)
  */
 static struct node_s *node_adopt(struct node_s *n, struct node_s *c, size_t index)
 {
+    /*
+     * A shared child stays wherever else it is, and the new slot takes a
+     * reference to it.
+     */
+    if(c->refs) {
+        n->table[index] = c;
+        c->refs++;
+        return c;
+    }
+
     /*
      * Dissociate the child from the owner.
      */
@@ -187,40 +284,74 @@ static struct node_s *node_adopt(struct node_s *n, struct node_s *c, size_t inde
  */
 
 /*
- * void node_free(struct node_s *n, bool recurse)
- * Free the current node, its value and recursively free
- * all of its children and their values and so on.
+ * Node memory helpers. Every allocation made on behalf of a node (the
+ * node itself, its table and its data, including whatever a type
+ * allocates for itself) goes through these, with the node's allocator,
+ * so that it is counted and ends up wherever the allocator puts it.
  */
-void node_free(struct node_s *n, bool recurse)
+void *node_mem_alloc(const struct node_allocator_s *a, size_t size)
 {
-    /*
-     * Sanity check to make sure there is a node being passed in.
-     */
-    if(!n)
+    void *p = a->alloc(a->ctx, size);
+
+    if(p) {
+        node_counts.allocs++;
+        node_mem_count((long long) size);
+    }
+
+    return p;
+}
+
+void *node_mem_realloc(const struct node_allocator_s *a, void *p, size_t old,
+    size_t size)
+{
+    void *new = a->realloc(a->ctx, p, old, size);
+
+    if(new) {
+        node_counts.allocs++;
+        node_mem_count((long long) size - (long long) (p ? old : 0));
+    }
+
+    return new;
+}
+
+void node_mem_free(const struct node_allocator_s *a, void *p, size_t size)
+{
+    if(!p)
         return;
-    pr_dbg("%s (%s) | recurse: %c", node_string(n), n->type->name, recurse ? 'T' : 'F');
 
-    /*
-     * After this, all the children along with the table itself
-     * will have been freed.
-     */
-    if(recurse && n->table)
-        node_free_table(n, recurse);
+    node_counts.frees++;
+    node_mem_count(-(long long) size);
+    a->free(a->ctx, p, size);
+}
 
+/*
+ * static void node_destroy(struct node_s *n)
+ * Free the node's data and the node itself. The node's owner and table
+ * must have been dealt with already.
+ */
+static void node_destroy(struct node_s *n)
+{
     /*
-     * Remove ourselves from any owner nodes.
+     * Data set up by 'init' lives in storage we allocated, so it is always
+     * ours to release. The type only has to clean up its internals.
      */
-    node_emancipate(n);
+    if(n->type->init) {
+        if(n->type->fini)
+            n->type->fini(n->data, n->alloc);
+
+        if(!node_type_inline(n->type))
+            node_mem_free(n->alloc, n->data, n->type->size);
 
     /*
-     * Check if it's our responsibility to free the data.
+     * Otherwise check if it's our responsibility to free the data.
      */
-    if(n->frees_data)
+    } else if(n->frees_data) {
         /*
          * The 'freev' function provided by the type must handle freeing all
          * its data internals up to and including n->data itself as it sees fit.
          */
         n->type->freev(n->data);
+    }
 
     /*
      * Free the node itself.
@@ -229,35 +360,147 @@ void node_free(struct node_s *n, bool recurse)
     n->str = 0;
 
     n->data = 0;
-    free(n);
+    node_mem_free(n->alloc, n, sizeof(struct node_s));
+}
+
+/*
+ * static void node_free_tree(struct node_s *n)
+ * Free n along with its children, their children and so on.
+ *
+ * Since the whole subtree is going away, nobody needs to be emancipated
+ * and no table needs tightening. We don't recurse either: the owner
+ * pointers, which we no longer need, are reused to link up a stack of
+ * nodes still waiting to be freed. Shared children only lose the
+ * reference their slot held, and join the stack once that was the last.
+ */
+static void node_free_tree(struct node_s *n)
+{
+    struct node_s *stack = n, *c;
+    size_t i;
+
+    n->owner = 0;
+
+    while((n = stack)) {
+        stack = n->owner;
+
+        for(i = 0; i < n->len; i++) {
+            if((c = n->table[i]) && (!c->refs || !--c->refs)) {
+                c->owner = stack;
+                stack = c;
+            }
+        }
+
+        if(n->table)
+            node_free_table(n);
+
+        node_destroy(n);
+    }
+}
+
+/*
+ * void node_free(struct node_s *n, bool recurse)
+ * Free the current node, its value and, if recurse is set, all of its
+ * children and their values and so on. Otherwise its children are
+ * left without an owner, and the references n's table held to shared
+ * children are handed to the caller.
+ *
+ * If n is shared, this drops a reference to it instead, and only frees it
+ * once that was the last one.
+ */
+void node_free(struct node_s *n, bool recurse)
+{
+    /*
+     * Sanity check to make sure there is a node being passed in.
+     */
+    if(!n)
+        return;
+    pr_dbg("%s (%s) | recurse: %c", node_string(n), n->type->name, recurse ? 'T' : 'F');
+
+    if(n->refs && --n->refs)
+        return;
+
+    /*
+     * Remove ourselves from any owner nodes.
+     */
+    node_emancipate(n);
+
+    if(recurse) {
+        node_free_tree(n);
+        return;
+    }
+
+    size_t i;
+    for(i = 0; i < n->len; i++) {
+        if(n->table[i]) {
+            n->table[i]->owner = 0;
+            n->table[i]->id = 0;
+        }
+    }
+
+    if(n->table)
+        node_free_table(n);
+
+    node_destroy(n);
 }
 
 /*
  * struct node_s *node_new(const struct node_type_s *type, const void *d, bool fsd);
  * Create a new node given its type and a const representation of its data.
+ * The node's memory comes from the calling thread's current allocator
+ * (see node_allocator_use).
  */
 struct node_s *node_new(const struct node_type_s *type, const void *d, bool fsd)
+{
+    return node_new_with(node_allocator(), type, d, fsd);
+}
+
+/*
+ * static struct node_s *node_make(const struct node_allocator_s *a,
+ *  const struct node_type_s *type, const void *d, size_t size, bool fsd)
+ * Create a new node. If size is 0, d is the type's initial data as
+ * node_new takes it, otherwise it's size bytes written by the type's
+ * 'serialize'.
+ */
+static struct node_s *node_make(const struct node_allocator_s *a,
+    const struct node_type_s *type, const void *d, size_t size, bool fsd)
 {
     pr_dbg("type: %s, d: %p", type->name, d);
     /*
      * Sanitize the input, so we don't waste time with null pointers.
      */
-    if(!d || !type)
+    if(!a || !d || !type)
         return 0;
 
     /*
      * Allocate the node structure.
      */
-    struct node_s *n = (struct node_s *) malloc(sizeof(struct node_s));
+    struct node_s *n = (struct node_s *)
+        node_mem_alloc(a, sizeof(struct node_s));
     if(!n)
         return 0;
 
     /*
      * Create the correct data structure and populate it using
-     * the initial data provided.
+     * the initial data provided. Types with an 'init' function have
+     * their storage set aside here, either inside the node or alongside it.
      */
-    if(!(n->data = type->new(d))) {
-        free(n);
+    if(type->init) {
+        n->data = node_type_inline(type) ? n->inline_data.bytes :
+            node_mem_alloc(a, type->size);
+
+        if(n->data && !(size ? type->deserialize(n->data, d, size, a) :
+            type->init(n->data, d, a))) {
+            if(!node_type_inline(type))
+                node_mem_free(a, n->data, type->size);
+
+            n->data = 0;
+        }
+    } else {
+        n->data = type->new(d);
+    }
+
+    if(!n->data) {
+        node_mem_free(a, n, sizeof(struct node_s));
         return 0;
     }
 
@@ -266,19 +509,53 @@ struct node_s *node_new(const struct node_type_s *type, const void *d, bool fsd)
      */
     n->type = type;
     n->frees_data = fsd;
+    n->refs = 0;
+    n->alloc = a;
+    n->policy = 0;
     n->owner = 0;
     n->table = 0;
     n->id = 0;
     n->len = 0;
     n->max = 0;
     n->count = 1;
+    n->height = 1;
     n->str = 0;
-    node_to_str(n);
 
     pr_dbg("n: %s (%s)", node_string(n), n->type->name);
     return n;
 }
 
+/*
+ * struct node_s *node_new_with(const struct node_allocator_s *a,
+ *  const struct node_type_s *type, const void *d, bool fsd);
+ * Create a new node whose memory, along with its table's and its data's,
+ * comes from the given allocator.
+ */
+struct node_s *node_new_with(const struct node_allocator_s *a,
+    const struct node_type_s *type, const void *d, bool fsd)
+{
+    return node_make(a, type, d, 0, fsd);
+}
+
+/*
+ * struct node_s *node_new_serialized(const struct node_allocator_s *a,
+ *  const struct node_type_s *type, const void *buf, size_t size)
+ *  Create a new node from the bytes its type's 'serialize' wrote, using
+ *  'deserialize' in place of 'init'.
+ *
+ * output:
+ *  struct node_s * - the node, or 0 if the type can't be deserialized,
+ *  the bytes weren't valid or there wasn't enough memory.
+ */
+struct node_s *node_new_serialized(const struct node_allocator_s *a,
+    const struct node_type_s *type, const void *buf, size_t size)
+{
+    if(!type || !type->init || !type->deserialize || !size)
+        return 0;
+
+    return node_make(a, type, buf, size, true);
+}
+
 /*
  * int node_diff(const struct node_s *a, const struct node_s *b);
  * Use this function instead of calling a node's diff directly.
@@ -303,9 +580,20 @@ int node_diff(const struct node_s *a, const struct node_s *b)
     return a->type->diff(a->data, b->data);
 }
 
+/*
+ * size_t node_hash(const struct node_s *n);
+ * Hash the node's data with its type's hash function. Types without
+ * one all hash to 0.
+ */
+size_t node_hash(const struct node_s *n)
+{
+    return n && n->type->hash ? n->type->hash(n->data) : 0;
+}
+
 /*
  * struct node_s *node_to_str(struct node_s *n)
- * Returns the str representation of the node.
+ * (Re)builds and caches the str representation of the node.
+ * Call this again if the node's data has changed since it was last built.
  */
 struct node_s *node_to_str(struct node_s *n)
 {
@@ -326,7 +614,8 @@ struct node_s *node_to_str(struct node_s *n)
 
 /*
  * char *node_string(struct node_s *n);
- * Get the str buf associated with this node.
+ * Get the str buf associated with this node. The str representation is
+ * built the first time it's asked for and cached in n->str.
  */
 char *node_string(struct node_s *n)
 {
@@ -339,9 +628,38 @@ char *node_string(struct node_s *n)
     if(n->type == node_type_str)
         return str_node_buf(n);
 
+    if(!n->str)
+        node_to_str(n);
+
     return str_node_buf(n->str);
 }
 
+/*
+ * int node_render(const struct node_s *n, char *buf, size_t size)
+ *  Write the node's str representation into buf without allocating.
+ *
+ * output:
+ *  int - the length of the full representation, as with snprintf. If it
+ *  is size or more, the output was truncated.
+ *
+ * notes:
+ *  - Types without a 'print' function fall back on node_string, which
+ *    builds and caches the representation as usual.
+ */
+int node_render(const struct node_s *n, char *buf, size_t size)
+{
+    if(!n)
+        return snprintf(buf, size, "%s", "");
+
+    if(n->type == node_type_node)
+        return node_render((const struct node_s *) n->data, buf, size);
+
+    if(n->type->print)
+        return n->type->print(n->data, buf, size);
+
+    return snprintf(buf, size, "%s", node_string((struct node_s *) n));
+}
+
 /*
  * size_t node_put(struct node_s *n, size_t index, struct node_s *new)
  *  Inserts a child node into a parent node at a given index.
@@ -363,6 +681,10 @@ char *node_string(struct node_s *n)
  *  - This function grows the parent node's table as necessary.
  *  - After insertion you can lookup the child node's current index in the
  *    parent's array by issuing c->id, where c is the pointer to the child node.
+ *  - If c is shared it isn't taken from anywhere else. The new slot takes
+ *    a reference to it instead, so it can't be looked up by c->id.
+ *  - If the node being replaced is shared, the reference its slot held
+ *    is dropped.
  */
 size_t node_put(struct node_s *n, size_t index, struct node_s *c)
 {
@@ -374,17 +696,25 @@ size_t node_put(struct node_s *n, size_t index, struct node_s *c)
      */
     if(!n || !c || (c->owner == n))
         return 0;
+
     /*
-     * Clear away any previous child elements.
+     * Clear away any previous child elements. A shared one is let go of
+     * only once c is in place, in case c is somewhere beneath it.
      */
-    if(node_at(n, index))
-        node_emancipate(node_at(n, index));
+    struct node_s *old = node_at(n, index);
+
+    if(old == c)
+        return n->len;
+
+    if(old && old->refs)
+        node_detach(n, index);
+    else if(old)
+        node_emancipate(old);
 
     /*
      * Make room for the new element as necessary.
      */
-    if((index >= n->max) &&
-        !node_resize_table(n, (index ? index : 1) << 1))
+    if((index >= n->max) && !node_grow_table(n, index))
         return 0;
 
     if(index >= n->len) {
@@ -403,55 +733,241 @@ size_t node_put(struct node_s *n, size_t index, struct node_s *c)
 
     node_adopt(n, c, index);
 
+    if(old && old->refs)
+        node_free_all(old);
+
     return n->len;
 }
 
-int node_bst_insert(struct node_s *a, struct node_s *b)
+/*
+ * void node_set(struct node_s *n, size_t index, struct node_s *c)
+ *  Store c at index in n's table, or clear the slot if c is 0.
+ *
+ * notes:
+ *  - Unlike node_put, this doesn't emancipate c from its previous owner
+ *    and never shrinks the table. It's meant for code which relinks many
+ *    nodes at once, such as the tree rotations in bst.c, and which takes
+ *    care of clearing the slots c used to occupy itself.
+ *  - It knows nothing of shared nodes, and makes n c's owner regardless.
+ */
+void node_set(struct node_s *n, size_t index, struct node_s *c)
+{
+    if(!n)
+        return;
+
+    if(!c) {
+        if(index < n->len)
+            n->table[index] = 0;
+
+        /*
+         * Forget about any trailing empty slots.
+         */
+        for(; n->len && !n->table[n->len - 1]; n->len--)
+            ;
+
+        return;
+    }
+
+    if((index >= n->max) && !node_grow_table(n, index))
+        return;
+
+    if(index >= n->len) {
+        node_clear_table(n, n->len, index - n->len);
+        n->len = index + 1;
+    }
+
+    n->table[index] = c;
+    c->owner = n;
+    c->id = index;
+}
+
+/*
+ * size_t node_reserve(struct node_s *n, size_t size)
+ *  Make sure n's table has room for at least size children, so that
+ *  filling it up doesn't cause any further resizing.
+ *
+ * output:
+ *  size_t - the table's capacity, or 0 if it couldn't be grown.
+ */
+size_t node_reserve(struct node_s *n, size_t size)
 {
-    if(!a || !b || (a->type != b->type))
+    if(!n)
         return 0;
 
-    int diff = node_diff(a, b);
+    if(size <= n->max)
+        return n->max;
 
-    if(diff < 0) {
-        if(node_at(a, NODE_RIGHT)) {
-            return node_bst_insert(node_at(a, NODE_RIGHT), b);
-        } else {
-            node_put(a, NODE_RIGHT, b);
-        }
-    } else {
-        if(node_at(a, NODE_LEFT)) {
-            return node_bst_insert(node_at(a, NODE_LEFT), b);
-        } else {
-            node_put(a, NODE_LEFT, b);
-        }
-    }
+    return node_resize_table(n, size);
+}
+
+/*
+ * size_t node_shrink_to_fit(struct node_s *n)
+ *  Shrink n's table down to its length, regardless of its policy.
+ *
+ * output:
+ *  size_t - the table's new capacity.
+ */
+size_t node_shrink_to_fit(struct node_s *n)
+{
+    if(!n || !n->max)
+        return 0;
+
+    for(; n->len && !n->table[n->len - 1]; n->len--)
+        ;
+
+    if(!n->len)
+        node_free_table(n);
+    else if(n->len < n->max)
+        node_resize_table(n, n->len);
 
-    return b->count;
+    return n->max;
 }
 
-void node_bt_for_each(struct node_s *n, void(*iter)(struct node_s *),
-    enum node_order_e o)
+/*
+ * struct node_s *node_bt_first(struct node_s *root, enum node_order_e o)
+ *  Return the first node of the binary tree at root in the given order.
+ */
+struct node_s *node_bt_first(struct node_s *root, enum node_order_e o)
 {
-    if(!n || !iter)
-        return;
+    struct node_s *c;
+
+    if(!root)
+        return 0;
+
+    switch(o) {
+        case NODE_IN_ORDER:
+            while((c = node_at(root, NODE_LEFT)))
+                root = c;
+            break;
+
+        case NODE_POST_ORDER:
+            while((c = node_at(root, NODE_LEFT)) ||
+                (c = node_at(root, NODE_RIGHT)))
+                root = c;
+            break;
 
-    if(o > NODE_PRE_ORDER) {
-        node_bt_for_each(node_at(n, NODE_LEFT), iter, o);
-        if(o == NODE_POST_ORDER)
-            node_bt_for_each(node_at(n, NODE_RIGHT), iter, o);
+        default:
+            ;
     }
 
-    iter(n);
+    return root;
+}
+
+/*
+ * struct node_s *node_bt_next(struct node_s *root, struct node_s *n,
+ *  enum node_order_e o)
+ *  Return the node after n in the binary tree at root in the given order,
+ *  or 0 if n is the last one.
+ *
+ * notes:
+ *  - We find our way back up the tree through the owner pointers, so this
+ *    takes no extra space. Nothing above root is ever visited.
+ */
+struct node_s *node_bt_next(struct node_s *root, struct node_s *n,
+    enum node_order_e o)
+{
+    struct node_s *c;
+
+    if(!root || !n)
+        return 0;
 
     switch(o) {
         case NODE_PRE_ORDER:
-            node_bt_for_each(node_at(n, NODE_LEFT), iter, o);
+            if((c = node_at(n, NODE_LEFT)) || (c = node_at(n, NODE_RIGHT)))
+                return c;
+
+            /*
+             * Climb until we find a right subtree we haven't visited yet.
+             */
+            for(; n != root; n = n->owner)
+                if(n->id == NODE_LEFT && (c = node_at(n->owner, NODE_RIGHT)))
+                    return c;
+
+            return 0;
+
         case NODE_IN_ORDER:
-            node_bt_for_each(node_at(n, NODE_RIGHT), iter, o);
-        default:
-            ;
+            if((c = node_at(n, NODE_RIGHT)))
+                return node_bt_first(c, NODE_IN_ORDER);
+
+            /*
+             * Climb for as long as we're coming up from the right.
+             */
+            for(; n != root && n->id == NODE_RIGHT; n = n->owner)
+                ;
+
+            return n == root ? 0 : n->owner;
+
+        case NODE_POST_ORDER:
+            if(n == root)
+                return 0;
+
+            if(n->id == NODE_LEFT && (c = node_at(n->owner, NODE_RIGHT)))
+                return node_bt_first(c, NODE_POST_ORDER);
+
+            return n->owner;
     }
+
+    return 0;
+}
+
+/*
+ * void node_iter_init(struct node_iter_s *it, struct node_s *root,
+ *  enum node_order_e o)
+ *  Set up a cursor over the binary tree at root. See node_iter_next.
+ */
+void node_iter_init(struct node_iter_s *it, struct node_s *root,
+    enum node_order_e o)
+{
+    if(!it)
+        return;
+
+    it->root = root;
+    it->order = o;
+    it->next = node_bt_first(root, o);
+}
+
+/*
+ * struct node_s *node_iter_next(struct node_iter_s *it)
+ *  Return the cursor's current node and move it along.
+ *
+ * output:
+ *  struct node_s * - the next node, or 0 once we've visited them all.
+ *
+ * notes:
+ *  - The cursor moves on before the node is returned, so in post-order
+ *    it's safe to unlink or free each node as you get it. Otherwise,
+ *    don't change the tree while you're iterating over it.
+ *  - Stop whenever you like and call node_iter_next again to resume.
+ */
+struct node_s *node_iter_next(struct node_iter_s *it)
+{
+    if(!it || !it->next)
+        return 0;
+
+    struct node_s *n = it->next;
+    it->next = node_bt_next(it->root, n, it->order);
+
+    return n;
+}
+
+/*
+ * void node_bt_for_each(struct node_s *n, void(*iter)(struct node_s *),
+ *  enum node_order_e o)
+ *  Pass every node of the binary tree at n to iter in the given order.
+ *  This doesn't recurse, so any tree depth is fine.
+ */
+void node_bt_for_each(struct node_s *n, void(*iter)(struct node_s *),
+    enum node_order_e o)
+{
+    struct node_iter_s it;
+    struct node_s *c;
+
+    if(!n || !iter)
+        return;
+
+    node_iter_init(&it, n, o);
+    while((c = node_iter_next(&it)))
+        iter(c);
 }
 
 /*
@@ -471,6 +987,7 @@ void node_bt_for_each(struct node_s *n, void(*iter)(struct node_s *),
  *  - This function shrinks the parent node's table as necessary.
  *  - If you have a node pointer c belonging to another node n you
  *      can look up c's index in n's table with 'c->id'.
+ *  - If the child is shared, the reference its slot held is now yours.
  */
 struct node_s *node_release(struct node_s *n, size_t index)
 {
@@ -484,7 +1001,9 @@ struct node_s *node_release(struct node_s *n, size_t index)
      * so all we have to do is make sure we've received something
      * back from it.
      */
-    if(ret)
+    if(ret && ret->refs)
+        node_detach(n, index);
+    else if(ret)
         node_emancipate(ret);
 
     /*
@@ -494,6 +1013,163 @@ struct node_s *node_release(struct node_s *n, size_t index)
     return ret;
 }
 
+/*
+ * struct node_s *node_share(struct node_s *n)
+ *  Let n be held by any number of tables at once. The reference it starts
+ *  with is its owner's table slot if it has an owner, which it then no
+ *  longer has, or the caller's otherwise.
+ *
+ * output:
+ *  struct node_s * - n.
+ *
+ * notes:
+ *  - Sharing can't be undone.
+ *  - Shared nodes have no owner or id, so they can't be used where those
+ *    matter: as map children, in binary trees or as graph vertices.
+ *  - A shared node mustn't end up beneath itself, or it will never be
+ *    freed.
+ */
+struct node_s *node_share(struct node_s *n)
+{
+    if(!n || n->refs)
+        return n;
+
+    n->refs = 1;
+    n->owner = 0;
+    n->id = 0;
+
+    return n;
+}
+
+/*
+ * struct node_s *node_ref(struct node_s *n)
+ *  Take a new reference to n, sharing it first if it isn't already. Drop
+ *  it with node_unref.
+ *
+ * output:
+ *  struct node_s * - n.
+ */
+struct node_s *node_ref(struct node_s *n)
+{
+    if(node_share(n))
+        n->refs++;
+
+    return n;
+}
+
+/*
+ * void node_allocator_set(const struct node_allocator_s *a)
+ *  Set the allocator for nodes created from now on, by any thread which
+ *  hasn't chosen its own with node_allocator_use. 0 means the heap.
+ *
+ * notes:
+ *  - Set it before starting any threads which create nodes.
+ *  - Nodes remember their allocator, so changing it while nodes are alive
+ *    is safe. Their tables and data follow them.
+ */
+void node_allocator_set(const struct node_allocator_s *a)
+{
+    node_allocator_global = a ? a : &node_allocator_heap;
+}
+
+/*
+ * void node_allocator_use(const struct node_allocator_s *a)
+ *  Set the allocator for nodes created by the calling thread from now on.
+ *  0 goes back to the one set with node_allocator_set.
+ */
+void node_allocator_use(const struct node_allocator_s *a)
+{
+    node_allocator_thread = a;
+}
+
+/*
+ * const struct node_allocator_s *node_allocator(void)
+ *  The allocator node_new would use on the calling thread.
+ */
+const struct node_allocator_s *node_allocator(void)
+{
+    return node_allocator_thread ? node_allocator_thread : node_allocator_global;
+}
+
+/*
+ * void node_pool_enable(bool enable)
+ *  Turn the node pool on or off for the calling thread. This is the same
+ *  as node_allocator_use(enable ? &node_allocator_pool : 0).
+ *
+ * notes:
+ *  - Pooled nodes must be freed on the thread that created them.
+ */
+void node_pool_enable(bool enable)
+{
+    node_allocator_use(enable ? &node_allocator_pool : 0);
+}
+
+bool node_pool_enabled(void)
+{
+    return node_allocator_thread == &node_allocator_pool;
+}
+
+/*
+ * void node_pool_reset(void)
+ *  Release every pooled node created by the calling thread, along with
+ *  their tables and data, without walking any of them.
+ *
+ * notes:
+ *  - Every pooled node becomes invalid, so make sure no unpooled node
+ *    still refers to one.
+ *  - Type 'fini' functions are not called. Memory the type acquired on its
+ *    own (such as a string's buffer) is not released.
+ */
+void node_pool_reset(void)
+{
+    pool_reset();
+}
+
+/*
+ * const struct node_stats_s *node_stats(void)
+ *  Get the calling thread's node memory counters. Every allocation made
+ *  through node_mem_alloc and friends (which is to say for every node,
+ *  table and payload, other than by a type's own 'new') is counted, as is
+ *  every time one is freed.
+ *
+ * notes:
+ *  - Memory freed on a different thread from the one which allocated it
+ *    is subtracted from that thread's bytes, which may go negative.
+ *  - node_pool_reset releases pooled memory without counting it.
+ */
+const struct node_stats_s *node_stats(void)
+{
+    return &node_counts;
+}
+
+/*
+ * void node_stats_reset(void)
+ *  Zero the calling thread's allocation and free counts, and start
+ *  tracking the peak again from the bytes currently in use.
+ */
+void node_stats_reset(void)
+{
+    node_counts.allocs = 0;
+    node_counts.frees = 0;
+    node_counts.peak = node_counts.bytes;
+}
+
+/*
+ * The allocators
+ */
+const struct node_allocator_s node_allocator_heap = {
+    .alloc = heap_alloc,
+    .realloc = heap_realloc,
+    .free = heap_free,
+    .thread_safe = true
+};
+
+const struct node_allocator_s node_allocator_pool = {
+    .alloc = node_pool_alloc,
+    .realloc = node_pool_realloc,
+    .free = node_pool_free
+};
+
 /*
  * The node type
  */
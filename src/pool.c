@@ -0,0 +1,215 @@
+/*
+ * pool.c
+ *
+ * A per-thread slab allocator for small, fixed-size objects.
+ *
+ * Small requests are served from per-size-class free lists. When a free
+ * list runs dry we carve a new block off the end of the current slab, and
+ * when the slab runs dry we allocate a new one. Slabs are never returned
+ * to the system individually; pool_reset releases all of them at once.
+ *
+ * Large requests bypass the slabs but are kept on a doubly-linked list
+ * so that pool_reset can release them as well.
+ */
+#include "common.h"
+
+/*
+ * macros
+ */
+#define pool_class(size) ((size) ? ((size) - 1) / POOL_ALIGN : 0)
+#define pool_round(size) ((pool_class(size) + 1) * POOL_ALIGN)
+
+/*
+ * Both headers are padded out to POOL_ALIGN so that the memory
+ * following them stays aligned.
+ */
+union pool_slab_u {
+    union pool_slab_u *next;
+    unsigned char pad[POOL_ALIGN];
+};
+
+union pool_large_u {
+    struct {
+        union pool_large_u *prev, *next;
+    } link;
+    unsigned char pad[POOL_ALIGN];
+};
+
+struct pool_s {
+    void *free[POOL_CLASSES];
+    union pool_slab_u *slabs;
+    union pool_large_u *large;
+    unsigned char *cur, *end;
+};
+
+static _Thread_local struct pool_s pool;
+
+/*
+ * static void *pool_carve(size_t size)
+ * Cut a new block off the current slab, allocating a new slab if
+ * there isn't enough room left in the current one.
+ */
+static void *pool_carve(size_t size)
+{
+    if(!pool.cur || (size_t) (pool.end - pool.cur) < size) {
+        union pool_slab_u *slab = (union pool_slab_u *)
+            malloc(POOL_SLAB_SIZE);
+        if(!slab)
+            return 0;
+
+        slab->next = pool.slabs;
+        pool.slabs = slab;
+        pool.cur = (unsigned char *) (slab + 1);
+        pool.end = (unsigned char *) slab + POOL_SLAB_SIZE;
+    }
+
+    void *p = pool.cur;
+    pool.cur += size;
+    return p;
+}
+
+static void *pool_large_alloc(size_t size)
+{
+    union pool_large_u *l = (union pool_large_u *)
+        malloc(sizeof(union pool_large_u) + size);
+    if(!l)
+        return 0;
+
+    l->link.prev = 0;
+    l->link.next = pool.large;
+    if(pool.large)
+        pool.large->link.prev = l;
+
+    pool.large = l;
+    return (void *) (l + 1);
+}
+
+static void pool_large_unlink(union pool_large_u *l)
+{
+    if(l->link.prev)
+        l->link.prev->link.next = l->link.next;
+    else
+        pool.large = l->link.next;
+
+    if(l->link.next)
+        l->link.next->link.prev = l->link.prev;
+}
+
+/*
+ * void *pool_alloc(size_t size)
+ * Allocate size bytes from the calling thread's pool.
+ */
+void *pool_alloc(size_t size)
+{
+    if(size > POOL_MAX)
+        return pool_large_alloc(size);
+
+    size_t c = pool_class(size);
+    void *p = pool.free[c];
+
+    /*
+     * Reuse a previously freed block if we have one. The first word of
+     * a free block points to the next free block of the same class.
+     */
+    if(p) {
+        pool.free[c] = *(void **) p;
+        return p;
+    }
+
+    return pool_carve(pool_round(size));
+}
+
+/*
+ * void *pool_realloc(void *p, size_t old, size_t size)
+ * Resize a block previously allocated with pool_alloc. As with
+ * pool_free, the caller must tell us how big the block was.
+ */
+void *pool_realloc(void *p, size_t old, size_t size)
+{
+    if(!p)
+        return pool_alloc(size);
+
+    /*
+     * Small blocks which stay within the same size class don't move.
+     */
+    if(old <= POOL_MAX && size <= POOL_MAX &&
+        pool_class(old) == pool_class(size))
+        return p;
+
+    /*
+     * Large blocks can be handed to realloc directly as long
+     * as we keep the list intact.
+     */
+    if(old > POOL_MAX && size > POOL_MAX) {
+        union pool_large_u *l = (union pool_large_u *) p - 1,
+            *new = (union pool_large_u *)
+                realloc(l, sizeof(union pool_large_u) + size);
+        if(!new)
+            return 0;
+
+        /*
+         * The block may have moved, so point its neighbours at it again.
+         */
+        if(new->link.prev)
+            new->link.prev->link.next = new;
+        else
+            pool.large = new;
+
+        if(new->link.next)
+            new->link.next->link.prev = new;
+
+        return (void *) (new + 1);
+    }
+
+    void *new = pool_alloc(size);
+    if(!new)
+        return 0;
+
+    memcpy(new, p, MIN(old, size));
+    pool_free(p, old);
+
+    return new;
+}
+
+/*
+ * void pool_free(void *p, size_t size)
+ * Return a block to the calling thread's pool.
+ */
+void pool_free(void *p, size_t size)
+{
+    if(!p)
+        return;
+
+    if(size > POOL_MAX) {
+        union pool_large_u *l = (union pool_large_u *) p - 1;
+        pool_large_unlink(l);
+        free(l);
+        return;
+    }
+
+    size_t c = pool_class(size);
+    *(void **) p = pool.free[c];
+    pool.free[c] = p;
+}
+
+/*
+ * void pool_reset(void)
+ * Release every block the calling thread has ever allocated from its
+ * pool, in time proportional to the number of slabs and large blocks.
+ */
+void pool_reset(void)
+{
+    while(pool.slabs) {
+        union pool_slab_u *next = pool.slabs->next;
+        free(pool.slabs);
+        pool.slabs = next;
+    }
+
+    while(pool.large) {
+        union pool_large_u *next = pool.large->link.next;
+        free(pool.large);
+        pool.large = next;
+    }
+
+    memset(&pool, 0, sizeof(pool));
+}
@@ -0,0 +1,694 @@
+/*
+ * serial.c
+ *
+ * Saving nodes to a file and loading them back.
+ *
+ * node_save numbers the nodes in the order it comes across them, going
+ * through each node's table, and the node its nested node or edge points
+ * at, before moving on to the next node. The nodes are written out as
+ * fixed size records, with their children and payloads in separate
+ * sections, so that a file can be used where it lies once it's mapped
+ * into memory.
+ *
+ * node_load goes through a view of the file. It creates all the nodes
+ * first and then links them up, since a nested node may point at a node
+ * further along in the file.
+ */
+#include "common.h"
+
+#define SERIAL_TYPES_MAX 64
+#define SERIAL_MIN 64
+
+#define serial_align(n) (((n) + 7) & ~(uint64_t) 7)
+
+/*
+ * A map from the nodes being saved to their index in the file, with
+ * linear probing. It's kept at most half full.
+ */
+struct serial_index_s {
+    const struct node_s **keys;
+    size_t *vals, len, max;
+};
+
+/*
+ * Everything node_save collects before writing the file. reached is set
+ * for nodes which something in the file owns, as opposed to nodes which
+ * are only pointed at.
+ */
+struct serial_save_s {
+    struct serial_index_s index;
+    const struct node_s **nodes;
+    bool *reached;
+    struct node_record_s *records;
+    uint64_t *children;
+    unsigned char *payload;
+    const struct node_type_s *types[SERIAL_TYPES_MAX];
+    size_t len, max, maxrecords, nchildren, maxchildren, size, maxsize,
+        ntypes;
+};
+
+static struct {
+    const struct node_type_s *types[SERIAL_TYPES_MAX];
+    size_t len;
+    pthread_mutex_t lock;
+} serial_types = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*
+ * static functions
+ */
+
+static size_t serial_hash(const struct node_s *n)
+{
+    uint64_t h = (uint64_t) (uintptr_t) n;
+
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+
+    return (size_t) (h ^ (h >> 31));
+}
+
+/*
+ * static bool serial_grow(void **p, size_t *max, size_t need, size_t size)
+ * Make sure the array at *p, of *max items of the given size, has room
+ * for need items, doubling it as necessary.
+ */
+static bool serial_grow(void **p, size_t *max, size_t need, size_t size)
+{
+    size_t max2 = *max ? *max : SERIAL_MIN;
+    void *p2;
+
+    if(need <= *max)
+        return true;
+
+    while(max2 < need)
+        max2 <<= 1;
+
+    if(!(p2 = realloc(*p, max2 * size)))
+        return false;
+
+    *p = p2;
+    *max = max2;
+
+    return true;
+}
+
+/*
+ * static size_t serial_index_slot(const struct serial_index_s *x,
+ *  const struct node_s *n)
+ * Find n's slot in the index, or the empty slot where it would go.
+ */
+static size_t serial_index_slot(const struct serial_index_s *x,
+    const struct node_s *n)
+{
+    size_t i = serial_hash(n) & (x->max - 1);
+
+    while(x->keys[i] && x->keys[i] != n)
+        i = (i + 1) & (x->max - 1);
+
+    return i;
+}
+
+static bool serial_index_grow(struct serial_index_s *x)
+{
+    struct serial_index_s y = { .max = x->max ? x->max << 1 : SERIAL_MIN };
+    size_t i, j;
+
+    y.keys = (const struct node_s **) calloc(y.max, sizeof(*y.keys));
+    y.vals = (size_t *) malloc(sizeof(size_t) * y.max);
+    if(!y.keys || !y.vals) {
+        free(y.keys);
+        free(y.vals);
+        return false;
+    }
+
+    for(i = 0; i < x->max; i++) {
+        if(x->keys[i]) {
+            j = serial_index_slot(&y, x->keys[i]);
+            y.keys[j] = x->keys[i];
+            y.vals[j] = x->vals[i];
+        }
+    }
+
+    y.len = x->len;
+    free(x->keys);
+    free(x->vals);
+    *x = y;
+
+    return true;
+}
+
+/*
+ * static uint64_t serial_add(struct serial_save_s *s, const struct node_s *n,
+ *  bool owned)
+ * Get n's index in the file, giving it the next one if it doesn't have
+ * one yet.
+ *
+ * output:
+ *  uint64_t - the index, or NODE_FILE_NONE if n is 0 or there wasn't
+ *  enough memory, in which case s->len is set to 0.
+ */
+static uint64_t serial_add(struct serial_save_s *s, const struct node_s *n,
+    bool owned)
+{
+    size_t i, max = s->max;
+
+    if(!n)
+        return NODE_FILE_NONE;
+
+    if((s->index.len + 1) * 2 > s->index.max &&
+        !serial_index_grow(&s->index))
+        goto fail;
+
+    i = serial_index_slot(&s->index, n);
+    if(s->index.keys[i]) {
+        s->reached[s->index.vals[i]] |= owned;
+        return s->index.vals[i];
+    }
+
+    if(!serial_grow((void **) &s->nodes, &s->max, s->len + 1,
+        sizeof(*s->nodes)))
+        goto fail;
+
+    /*
+     * nodes and reached grow together.
+     */
+    if(s->max != max) {
+        bool *reached = (bool *) realloc(s->reached, sizeof(bool) * s->max);
+        if(!reached)
+            goto fail;
+
+        s->reached = reached;
+    }
+    s->index.keys[i] = n;
+    s->index.vals[i] = s->len;
+    s->index.len++;
+    s->nodes[s->len] = n;
+    s->reached[s->len] = owned;
+
+    return s->len++;
+
+fail:
+    s->len = 0;
+    return NODE_FILE_NONE;
+}
+
+/*
+ * static bool serial_record(struct serial_save_s *s, size_t i)
+ * Fill in the record for the ith node, adding whatever it holds or
+ * points at to the nodes to be saved.
+ */
+static bool serial_record(struct serial_save_s *s, size_t i)
+{
+    const struct node_s *n = s->nodes[i];
+    struct node_record_s r = {
+        .ref = NODE_FILE_NONE,
+        .flags = (n->frees_data ? NODE_RECORD_FREES_DATA : 0) |
+            (node_shared(n) ? NODE_RECORD_SHARED : 0),
+        .len = n->len,
+        .count = n->count,
+        .height = n->height
+    };
+    size_t j;
+
+    for(r.type = 0; r.type < s->ntypes; r.type++)
+        if(s->types[r.type] == n->type)
+            break;
+
+    if(r.type == s->ntypes) {
+        if(s->ntypes == SERIAL_TYPES_MAX || !node_type_find(n->type->name) ||
+            node_type_find(n->type->name) != n->type)
+            return false;
+
+        s->types[s->ntypes++] = n->type;
+    }
+
+    /*
+     * Whatever a nested node points at is its own if it frees its data.
+     * An edge never owns where it leads.
+     */
+    if(n->type == node_type_node) {
+        r.ref = serial_add(s, node_data(n), n->frees_data);
+    } else if(n->type == node_type_edge) {
+        r.ref = serial_add(s, edge_node_to(n), false);
+    }
+
+    if(!s->len)
+        return false;
+
+    if(n->type != node_type_node) {
+        r.payload = s->size;
+        r.size = n->type->serialize(n->data, 0, 0);
+
+        if(!r.size || !serial_grow((void **) &s->payload, &s->maxsize,
+            serial_align(s->size + r.size), 1))
+            return false;
+
+        n->type->serialize(n->data, s->payload + s->size, r.size);
+        memset(s->payload + s->size + r.size, 0,
+            serial_align(r.size) - r.size);
+        s->size += serial_align(r.size);
+    }
+
+    r.children = s->nchildren;
+    if(!serial_grow((void **) &s->children, &s->maxchildren,
+        s->nchildren + n->len, sizeof(uint64_t)))
+        return false;
+
+    for(j = 0; j < n->len; j++) {
+        s->children[s->nchildren++] = serial_add(s, n->table[j], true);
+        if(!s->len)
+            return false;
+    }
+
+    if(!serial_grow((void **) &s->records, &s->maxrecords, i + 1,
+        sizeof(*s->records)))
+        return false;
+
+    s->records[i] = r;
+
+    return true;
+}
+
+/*
+ * static bool serial_write(struct serial_save_s *s, const char *path)
+ * Write out everything node_save has collected.
+ */
+static bool serial_write(struct serial_save_s *s, const char *path)
+{
+    struct node_file_s h = {
+        .magic = NODE_FILE_MAGIC,
+        .version = NODE_FILE_VERSION,
+        .ntypes = s->ntypes,
+        .nnodes = s->len,
+        .nchildren = s->nchildren,
+        .types = sizeof(struct node_file_s)
+    };
+    char name[NODE_FILE_NAME_SIZE];
+    FILE *f = fopen(path, "wb");
+    bool ok = f != 0;
+    size_t i;
+
+    h.records = serial_align(h.types + NODE_FILE_NAME_SIZE * h.ntypes);
+    h.children = h.records + sizeof(struct node_record_s) * h.nnodes;
+    h.payload = h.children + sizeof(uint64_t) * h.nchildren;
+    h.size = h.payload + s->size;
+
+    ok = ok && fwrite(&h, sizeof(h), 1, f) == 1;
+
+    for(i = 0; ok && i < s->ntypes; i++) {
+        memset(name, 0, sizeof(name));
+        strcpy(name, s->types[i]->name);
+        ok = fwrite(name, sizeof(name), 1, f) == 1;
+    }
+
+    memset(name, 0, sizeof(name));
+    ok = ok && fwrite(name, 1, h.records - h.types -
+        NODE_FILE_NAME_SIZE * h.ntypes, f) == h.records - h.types -
+        NODE_FILE_NAME_SIZE * h.ntypes;
+
+    ok = ok && fwrite(s->records, sizeof(*s->records), s->len, f) == s->len;
+    ok = ok && fwrite(s->children, sizeof(uint64_t), s->nchildren, f) ==
+        s->nchildren;
+    ok = ok && fwrite(s->payload, 1, s->size, f) == s->size;
+
+    if(f && fclose(f))
+        ok = false;
+
+    return ok;
+}
+
+/*
+ * static bool serial_check(const struct node_view_s *v, size_t size)
+ * Make sure every offset and index in a mapped file of the given size
+ * is within bounds, so that the view can be used without further checks.
+ */
+static bool serial_check(const struct node_view_s *v, size_t size)
+{
+    const struct node_file_s *h = v->file;
+    const struct node_record_s *r;
+    size_t i, j;
+
+    if(size < sizeof(*h) || h->magic != NODE_FILE_MAGIC ||
+        h->version != NODE_FILE_VERSION || h->size != size || !h->nnodes)
+        return false;
+
+    if(h->types != sizeof(*h) || h->ntypes > size / NODE_FILE_NAME_SIZE ||
+        h->records != serial_align(h->types + NODE_FILE_NAME_SIZE * h->ntypes) ||
+        h->nnodes > size / sizeof(*r) ||
+        h->children != h->records + sizeof(*r) * h->nnodes ||
+        h->nchildren > size / sizeof(uint64_t) ||
+        h->payload != h->children + sizeof(uint64_t) * h->nchildren ||
+        h->payload > size)
+        return false;
+
+    for(i = 0; i < h->ntypes; i++)
+        if(!memchr((const char *) h + h->types + NODE_FILE_NAME_SIZE * i, 0,
+            NODE_FILE_NAME_SIZE))
+            return false;
+
+    for(i = 0; i < h->nnodes; i++) {
+        r = v->records + i;
+
+        if(r->type >= h->ntypes || r->payload > size - h->payload ||
+            r->size > size - h->payload - r->payload ||
+            r->children > h->nchildren || r->len > h->nchildren - r->children ||
+            (r->ref != NODE_FILE_NONE && r->ref >= h->nnodes))
+            return false;
+
+        for(j = 0; j < r->len; j++)
+            if(v->children[r->children + j] != NODE_FILE_NONE &&
+                v->children[r->children + j] >= h->nnodes)
+                return false;
+    }
+
+    return true;
+}
+
+/*
+ * static bool serial_own(const struct node_view_s *v, unsigned char *owners,
+ *  uint64_t i)
+ * Count an owner for the ith node of a file being loaded.
+ *
+ * output:
+ *  bool - false if the node already has an owner and isn't shared.
+ */
+static bool serial_own(const struct node_view_s *v, unsigned char *owners,
+    uint64_t i)
+{
+    if(node_view_at(v, i)->flags & NODE_RECORD_SHARED) {
+        owners[i] = 1;
+        return true;
+    }
+
+    return !owners[i]++;
+}
+
+/*
+ * static void serial_types_init(void)
+ * Register the types in this library which can be saved.
+ */
+static void serial_types_init(void)
+{
+    if(serial_types.len)
+        return;
+
+    serial_types.types[serial_types.len++] = node_type_node;
+    serial_types.types[serial_types.len++] = node_type_int;
+    serial_types.types[serial_types.len++] = node_type_str;
+    serial_types.types[serial_types.len++] = node_type_edge;
+}
+
+/*
+ * non-static functions
+ */
+
+/*
+ * bool node_type_register(const struct node_type_s *type)
+ *  Let nodes of the given type be saved and loaded. The type needs
+ *  'init', 'serialize' and 'deserialize', and a name shorter than
+ *  NODE_FILE_NAME_SIZE which no other registered type has.
+ */
+bool node_type_register(const struct node_type_s *type)
+{
+    if(!type || !type->init || !type->serialize || !type->deserialize ||
+        !type->name || strlen(type->name) >= NODE_FILE_NAME_SIZE)
+        return false;
+
+    const struct node_type_s *t = node_type_find(type->name);
+    bool ok = t == type;
+
+    pthread_mutex_lock(&serial_types.lock);
+    if(!t && serial_types.len < SERIAL_TYPES_MAX) {
+        serial_types.types[serial_types.len++] = type;
+        ok = true;
+    }
+    pthread_mutex_unlock(&serial_types.lock);
+
+    return ok;
+}
+
+/*
+ * const struct node_type_s *node_type_find(const char *name)
+ *  Find the registered type with the given name.
+ */
+const struct node_type_s *node_type_find(const char *name)
+{
+    const struct node_type_s *t = 0;
+    size_t i;
+
+    pthread_mutex_lock(&serial_types.lock);
+    serial_types_init();
+
+    for(i = 0; name && !t && i < serial_types.len; i++)
+        if(!strcmp(serial_types.types[i]->name, name))
+            t = serial_types.types[i];
+
+    pthread_mutex_unlock(&serial_types.lock);
+
+    return t;
+}
+
+/*
+ * bool node_save(const struct node_s *n, const char *path)
+ *  Save n and everything it holds to a file.
+ *
+ * output:
+ *  bool - false if a node's type can't be saved, a nested node or edge
+ *  points at a node which n doesn't hold, or the file couldn't be
+ *  written.
+ */
+bool node_save(const struct node_s *n, const char *path)
+{
+    if(!n || !path)
+        return false;
+
+    struct serial_save_s s = { 0 };
+    bool ok = serial_add(&s, n, true) == 0;
+    size_t i;
+
+    for(i = 0; ok && i < s.len; i++)
+        ok = serial_record(&s, i);
+
+    for(i = 0; ok && i < s.len; i++)
+        ok = s.reached[i];
+
+    ok = ok && serial_write(&s, path);
+
+    free(s.index.keys);
+    free(s.index.vals);
+    free(s.nodes);
+    free(s.reached);
+    free(s.records);
+    free(s.children);
+    free(s.payload);
+
+    return ok;
+}
+
+/*
+ * struct node_view_s *node_view_open(const char *path)
+ *  Map a saved file into memory for reading.
+ *
+ * output:
+ *  struct node_view_s * - the view, to be closed with node_view_close, or
+ *  0 if the file couldn't be read or isn't a valid node file.
+ */
+struct node_view_s *node_view_open(const char *path)
+{
+    struct node_view_s *v;
+    struct stat st;
+    void *p;
+    size_t i;
+    int fd;
+
+    if(!path || (fd = open(path, O_RDONLY)) < 0)
+        return 0;
+
+    if(fstat(fd, &st) || st.st_size < (off_t) sizeof(struct node_file_s) ||
+        (p = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return 0;
+    }
+
+    close(fd);
+
+    const struct node_file_s *h = (const struct node_file_s *) p;
+
+    v = (struct node_view_s *) calloc(1, sizeof(struct node_view_s));
+    if(v) {
+        v->file = h;
+        v->records = (const struct node_record_s *)
+            ((const char *) p + h->records);
+        v->children = (const uint64_t *) ((const char *) p + h->children);
+        v->payload = (const unsigned char *) p + h->payload;
+    }
+
+    if(!v || !serial_check(v, st.st_size) || !(v->types =
+        (const struct node_type_s **) malloc(sizeof(*v->types) *
+        (h->ntypes ? h->ntypes : 1)))) {
+        free(v);
+        munmap(p, st.st_size);
+        return 0;
+    }
+
+    for(i = 0; i < h->ntypes; i++)
+        v->types[i] = node_type_find((const char *) p + h->types +
+            NODE_FILE_NAME_SIZE * i);
+
+    return v;
+}
+
+void node_view_close(struct node_view_s *v)
+{
+    if(!v)
+        return;
+
+    munmap((void *) v->file, v->file->size);
+    free(v->types);
+    free(v);
+}
+
+/*
+ * struct node_s *node_load(const char *path)
+ *  Load a saved file, making all its nodes again with the calling
+ *  thread's allocator.
+ *
+ * output:
+ *  struct node_s * - the node that was passed to node_save, or 0 if the
+ *  file couldn't be read, isn't a valid node file, has types which
+ *  aren't registered, or there wasn't enough memory.
+ */
+struct node_s *node_load(const char *path)
+{
+    struct node_view_s *v = node_view_open(path);
+    if(!v)
+        return 0;
+
+    size_t len = node_view_len(v), i, j, c, head = 0, tail = 0;
+    struct node_s **nodes = (struct node_s **) calloc(len, sizeof(*nodes)), *n;
+    size_t *queue = (size_t *) malloc(sizeof(size_t) * len);
+    unsigned char *owners = (unsigned char *) calloc(len, 1);
+    const struct node_record_s *r;
+    const struct node_type_s *t;
+    bool ok = nodes && queue && owners;
+
+    /*
+     * Every node apart from the first must have exactly one owner, or at
+     * least one if it's shared, and be held by the first one through its
+     * owners, or freeing the nodes would go wrong. Once counted, owners is
+     * set to 2 for each node the search reaches.
+     */
+    for(i = 0; ok && i < len; i++) {
+        r = node_view_at(v, i);
+        t = node_view_type(v, i);
+
+        if(!t || ((t == node_type_node) != !r->size) ||
+            (t == node_type_node && r->ref == NODE_FILE_NONE))
+            ok = false;
+
+        if(ok && t == node_type_node && (r->flags & NODE_RECORD_FREES_DATA))
+            ok = serial_own(v, owners, r->ref);
+
+        for(j = 0; ok && j < r->len; j++)
+            if((c = node_view_child(v, i, j)) != NODE_FILE_NONE)
+                ok = serial_own(v, owners, c);
+    }
+
+    ok = ok && !owners[0];
+    for(queue[tail++] = 0, owners[0] = 2; ok && head < tail; head++) {
+        r = node_view_at(v, queue[head]);
+
+        if(node_view_type(v, queue[head]) == node_type_node &&
+            (r->flags & NODE_RECORD_FREES_DATA) && owners[r->ref] == 1) {
+            queue[tail++] = r->ref;
+            owners[r->ref] = 2;
+        }
+
+        for(j = 0; j < r->len; j++) {
+            if((c = node_view_child(v, queue[head], j)) != NODE_FILE_NONE &&
+                owners[c] == 1) {
+                queue[tail++] = c;
+                owners[c] = 2;
+            }
+        }
+    }
+
+    ok = ok && tail == len;
+    free(queue);
+
+    /*
+     * Nested nodes get pointed at the right node below, and are only
+     * told to free it once nothing else can go wrong.
+     */
+    for(i = 0; ok && i < len; i++) {
+        t = node_view_type(v, i);
+        nodes[i] = n = t == node_type_node ?
+            node_new_node_const(nodes) :
+            node_new_serialized(node_allocator(), t, node_view_data(v, i),
+            node_view_size(v, i));
+
+        ok = n && node_reserve(n, node_view_children(v, i)) >=
+            node_view_children(v, i);
+    }
+
+    if(!ok) {
+        for(i = 0; nodes && i < len; i++)
+            node_free_one(nodes[i]);
+
+        free(nodes);
+        free(owners);
+        node_view_close(v);
+        return 0;
+    }
+
+    /*
+     * Shared nodes start out with a reference of their own and gain one
+     * as each holder is linked up.
+     */
+    for(i = 0; i < len; i++)
+        if(node_view_at(v, i)->flags & NODE_RECORD_SHARED)
+            node_share(nodes[i]);
+
+    for(i = 0; i < len; i++) {
+        r = node_view_at(v, i);
+        n = nodes[i];
+
+        if(n->type == node_type_node) {
+            n->data = nodes[r->ref];
+            n->frees_data = r->flags & NODE_RECORD_FREES_DATA;
+            if(n->frees_data && node_shared(node_data(n)))
+                node_data(n)->refs++;
+        } else if(n->type == node_type_edge && r->ref != NODE_FILE_NONE) {
+            edge_node_to(n) = nodes[r->ref];
+        }
+
+        for(j = 0; j < r->len; j++) {
+            if((c = node_view_child(v, i, j)) == NODE_FILE_NONE)
+                continue;
+
+            node_set(n, j, nodes[c]);
+            if(node_shared(nodes[c])) {
+                nodes[c]->owner = 0;
+                nodes[c]->id = 0;
+                nodes[c]->refs++;
+            }
+        }
+
+        n->count = r->count;
+        n->height = r->height;
+    }
+
+    /*
+     * Only the first node keeps its own reference, which is the caller's.
+     */
+    for(i = 1; i < len; i++)
+        if(node_shared(nodes[i]))
+            nodes[i]->refs--;
+
+    n = nodes[0];
+    free(nodes);
+    free(owners);
+    node_view_close(v);
+
+    return n;
+}
@@ -3,12 +3,161 @@
  *
  * A simple node-based stack implementation.
  *
+ * The stack is a single node whose data is a ring buffer of node
+ * pointers. Items are added and removed at either end by moving the
+ * head index and length around the buffer, which doubles in size
+ * whenever it fills up. Nothing is allocated per item.
+ *
+ * A stack is freed (and set back to 0) when its last item is taken, but
+ * each thread keeps the last heap allocated stack it drained as a spare,
+ * provided its buffer never grew, and the next stack it creates takes
+ * that over. A queue which is drained between items therefore doesn't
+ * allocate either. The spare is freed when the thread exits.
+ *
  * Ilia Bykow, 2015
  */
 
 #include "common.h"
 
-#define STACK_INDEX NODE_NEXT
+#define STACK_MIN 8
+
+/*
+ * Map a position within the stack (0 being the bottom) to its index
+ * within the ring buffer. The buffer size is always a power of two.
+ */
+#define stack_index(s, i) (((s)->head + (i)) & ((s)->max - 1))
+
+/*
+ * static functions
+ */
+
+static _Thread_local struct node_s *stack_spare;
+static pthread_key_t stack_spare_key;
+static pthread_once_t stack_spare_once = PTHREAD_ONCE_INIT;
+
+static void stack_spare_free(void *n)
+{
+    node_free_all((struct node_s *) n);
+    stack_spare = 0;
+}
+
+static void stack_spare_init(void)
+{
+    pthread_key_create(&stack_spare_key, stack_spare_free);
+}
+
+static bool stack_set(void *data, const void *init,
+    const struct node_allocator_s *a)
+{
+    memset(data, 0, sizeof(struct stack_s));
+    return true;
+}
+
+static void stack_clear(void *data, const struct node_allocator_s *a)
+{
+    node_mem_free(a, stack_get(data)->buf,
+        sizeof(struct node_s *) * stack_get(data)->max);
+}
+
+static int stack_diff(const void *a, const void *b)
+{
+    return (int) stack_get(a)->len - (int) stack_get(b)->len;
+}
+
+static int stack_print(const void *data, char *buf, size_t size)
+{
+    return snprintf(buf, size, "stack of %lu", stack_get(data)->len);
+}
+
+static struct node_s *stack_to_str(const void *data)
+{
+    char s[100];
+    stack_print(data, s, sizeof(s));
+    return str_node_new(s);
+}
+
+/*
+ * static struct stack_s *stack_room(struct node_s **stack)
+ * Get the stack's ring buffer ready for one more item, creating the
+ * stack if it doesn't exist yet.
+ */
+static struct stack_s *stack_room(struct node_s **stack)
+{
+    if(!*stack && stack_spare && node_allocator() == &node_allocator_heap) {
+        *stack = stack_spare;
+        stack_spare = 0;
+        pthread_setspecific(stack_spare_key, 0);
+    }
+
+    /*
+     * stack_set doesn't need any initial data, but node_new insists
+     * on a pointer.
+     */
+    if(!*stack && !(*stack = node_new(node_type_stack, stack, true)))
+        return 0;
+
+    struct stack_s *s = stack_get((*stack)->data);
+
+    if(s->len < s->max)
+        return s;
+
+    /*
+     * Double the buffer, straightening out the ring as we go so that
+     * the bottom of the stack ends up at index 0.
+     */
+    size_t max = s->max ? s->max << 1 : STACK_MIN,
+           bottom = s->max - s->head;
+    const struct node_s **buf = (const struct node_s **)
+        node_mem_alloc((*stack)->alloc, sizeof(struct node_s *) * max);
+    if(!buf)
+        return 0;
+
+    if(s->len) {
+        memcpy(buf, s->buf + s->head, sizeof(struct node_s *) * bottom);
+        memcpy(buf + bottom, s->buf, sizeof(struct node_s *) * s->head);
+    }
+
+    node_mem_free((*stack)->alloc, s->buf, sizeof(struct node_s *) * s->max);
+    s->buf = buf;
+    s->head = 0;
+    s->max = max;
+
+    return s;
+}
+
+/*
+ * static struct node_s *stack_taken(struct node_s **stack,
+ *  const struct node_s *n)
+ * Free the stack once its last item has been taken, or keep it as the
+ * thread's spare. Only heap allocated stacks are kept: a pooled one
+ * would be gone after node_pool_reset, and other allocators may have
+ * their own ideas about when memory goes away.
+ */
+static struct node_s *stack_taken(struct node_s **stack,
+    const struct node_s *n)
+{
+    if(stack_len(*stack))
+        return (struct node_s *) n;
+
+    struct stack_s *s = stack_get((*stack)->data);
+
+    if(!stack_spare && (*stack)->alloc == &node_allocator_heap
+        && s->max <= STACK_MIN) {
+        pthread_once(&stack_spare_once, stack_spare_init);
+        s->head = 0;
+        stack_spare = *stack;
+        pthread_setspecific(stack_spare_key, stack_spare);
+    } else {
+        node_free_all(*stack);
+    }
+
+    *stack = 0;
+    return (struct node_s *) n;
+}
+
+/*
+ * non-static functions
+ */
 
 /*
  * void stack_push(struct node_s **stack, const struct node_s *n);
@@ -41,9 +190,10 @@
  *      }
  * }
  *
- * This function warps whatever node you want to push inside an outer
- * nested node structure. This way we avoid modifying the stack element's
- * table contents in any way.
+ * The stack only keeps a pointer to the node you push. It doesn't touch
+ * the node's table or owner, and freeing the stack won't free the node.
+ * The stack itself is freed (and set back to 0) once its last item has
+ * been taken out.
  *
  * If you want to create a stack using your current node's table directly,
  * you should not use this function but rather, just put your node inside
@@ -63,50 +213,32 @@ void stack_push(struct node_s **stack, const struct node_s *n)
     if(!stack || !n)
         return;
 
-    /*
-     * Create a nested stack node around the node we want
-     * to insert.
-     */
-    struct node_s *next = node_new_node_const(n);
-    pr_dbg("*stack: %p, n: %p, next: %p", *stack, n, next);
+    struct stack_s *s = stack_room(stack);
+    pr_dbg("*stack: %p, n: %p", *stack, n);
 
-    /*
-     * Make sure the allocation went smoothly.
-     */
-    if(!next)
+    if(!s)
         return;
 
-    /*
-     * If the stack isn't empty, push it down.
-     */
-    if(*stack) {
-
-        /*
-         * Maintain the circular linked list.
-         */
-        if((*stack)->owner) {
-
-            /*
-             * The stack owner is the 'last' element on the stack.
-             */
-            node_put((*stack)->owner, STACK_INDEX, next);
-
-        } else {
-
-            /*
-             * No owner means we haven't created a circular list yet.
-             */
-            node_put(*stack, STACK_INDEX, next);
-        }
+    s->buf[stack_index(s, s->len)] = n;
+    s->len++;
+}
 
-        node_put(next, STACK_INDEX, *stack);
-    }
+/*
+ * void stack_unshift(struct node_s **stack, const struct node_s *n);
+ * Put a node at the bottom of the stack (the front of the queue).
+ */
+void stack_unshift(struct node_s **stack, const struct node_s *n)
+{
+    if(!stack || !n)
+        return;
 
-    /*
-     * Move the stack up to the current head.
-     */
-    *stack = next;
+    struct stack_s *s = stack_room(stack);
+    if(!s)
+        return;
 
+    s->head = stack_index(s, s->max - 1);
+    s->buf[s->head] = n;
+    s->len++;
 }
 
 /*
@@ -115,120 +247,48 @@ void stack_push(struct node_s **stack, const struct node_s *n)
  */
 struct node_s *stack_pop(struct node_s **stack)
 {
-
     /*
      * Sanitize.
      */
     if(!stack || !*stack)
         return 0;
 
-    /*
-     * Take out the next stack node as well as the data
-     * from the current one.
-     */
-    struct node_s *next = node_release(*stack, STACK_INDEX),
-                    *n = node_data(*stack);
+    struct stack_s *s = stack_get((*stack)->data);
 
-    /*
-     * Free the, now empty, head of the stack.
-     */
-    node_free_all(*stack);
-
-    /*
-     * Move the stack down to the new head.
-     */
-    *stack = next;
-
-    /*
-     * Return the data;
-     */
-    return n;
+    s->len--;
+    return stack_taken(stack, s->buf[stack_index(s, s->len)]);
 }
 
 /*
  * struct node_s *stack_deq(struct node_s **stack);
  * Return the bottom-most node from the "stack" (queue).
- *
- * Since the stack is built as a doubly-linked circular list
- * We simply return the value stored in the stack's owner node.
  */
 struct node_s *stack_deq(struct node_s **q)
 {
     if(!q || !*q)
         return 0;
 
-    struct node_s *n;
-    pr_dbg("*q: %p, (*q)->type: %p", *q, (*q)->type);
+    struct stack_s *s = stack_get((*q)->data);
+    const struct node_s *n = s->buf[s->head];
+    pr_dbg("*q: %p, n: %p", *q, n);
 
-    /*
-     * Having an owner means that we have two or more items left in the queue.
-     */
-    if((*q)->owner) {
-
-        /*
-         * Remember the element before last.
-         */
-        struct node_s *prev = (*q)->owner->owner, *current;
-        /*
-         * Remember the node we want to get the data from and release it
-         * from its owner.
-         */
-        current = node_release(prev, STACK_INDEX);
-
-        /*
-         * Check whether we're down to our last two elements.
-         */
-        if(*q == prev) {
-
-            /*
-             * If so, release the remaining element.
-             */
-            node_release(current, STACK_INDEX);
-
-        } else {
-
-            /*
-             * Otherwise, reattach the new 'bottom' node with the current 'top'.
-             */
-            node_put(prev, STACK_INDEX, *q);
-        }
-
-        /*
-         * Get the data we want to return.
-         */
-        n = node_data(current);
-        pr_dbg("*q: %p, current: %p, prev: %p, n: %p, current->owner: %p, (*q)->owner: %p",
-            *q, current, prev, n, current->owner, prev->owner);
-
-        /*
-         * Free the, now unused, empty and emancipated node.
-         * We are assuming this node was created in the q_push process
-         * and will therefore not free its data which is itself a node.
-         */
-        node_free_all(current);
+    s->head = stack_index(s, 1);
+    s->len--;
 
-    /*
-     * Otherwise, if we don't have an owner then we are the last node
-     * in the queue.
-     */
-    } else {
-
-        /*
-         * Hold on to the data.
-         */
-        n = node_data(*q);
-        pr_dbg("*q: %p, n: %p - END OF QUEUE.............!", *q, n);
-
-        /*
-         * Free the last node.
-         */
-        node_free_all(*q);
-
-        /*
-         * Keep track of the fact that we're empty.
-         */
-        *q = 0;
-    }
-
-    return n;
+    return stack_taken(q, n);
 }
+
+/*
+ * The stack type
+ */
+static const struct node_type_s _type_stack = {
+    .size = sizeof(struct stack_s),
+    .init = stack_set,
+    .fini = stack_clear,
+    .diff = stack_diff,
+    .to_str = stack_to_str,
+    .print = stack_print,
+    .name = "stack"
+};
+
+const struct node_type_s *node_type_stack = &_type_stack;
@@ -1,39 +1,356 @@
 #include "common.h"
 
-static void str_free(void *data)
+/*
+ * String interning
+ *
+ * Interned strings share a single, reference counted buffer per distinct
+ * string. The buffers are kept in an open addressing hash set which is
+ * shared by all threads and protected by a mutex. Whether interning is on
+ * is a flag of its own, so that creating a string doesn't have to take
+ * the lock just to find out.
+ *
+ * Strings shorter than STR_SSO_SIZE are never interned: they live inside
+ * their node, so a shared buffer would only cost them memory.
+ *
+ * The set and its buffers outlive any one node and may be shared by
+ * nodes with different allocators, so they always come from the heap
+ * allocator, whatever the nodes use. They go through node_mem_alloc all
+ * the same, so node_stats counts them.
+ */
+
+#define STR_INTERN_MIN 64
+
+/*
+ * Get the intern entry a shared buffer belongs to.
+ */
+#define str_intern_entry(b) \
+    ((struct str_intern_s *) ((b) - offsetof(struct str_intern_s, buf)))
+
+struct str_intern_s {
+    size_t refs, len, hash;
+    char buf[];
+};
+
+static struct {
+    struct str_intern_s **slots;
+    size_t len, max;
+    atomic_bool enabled;
+    pthread_mutex_t lock;
+} str_interned = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*
+ * Hashing and comparison kernels
+ */
+
+#define STR_P1 0x9e3779b185ebca87ULL
+#define STR_P2 0xc2b2ae3d27d4eb4fULL
+
+#define str_rotl(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t str_load(const char *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+static inline uint64_t str_round(uint64_t h, uint64_t w)
+{
+    h += w * STR_P2;
+    return str_rotl(h, 31) * STR_P1;
+}
+
+/*
+ * size_t str_hash_buf(const char *buf, size_t len)
+ * A 64-bit hash which consumes the string eight bytes at a time. Long
+ * strings are split across four independent lanes, which the processor
+ * (or the compiler's vectorizer) can work on in parallel, and the
+ * result is put through the splitmix64 finalizer so that every bit of
+ * the input affects the low bits we index hash tables with.
+ */
+size_t str_hash_buf(const char *buf, size_t len)
+{
+    uint64_t h = STR_P1 ^ (len * STR_P2), w;
+    const char *p = buf, *end = buf + len;
+
+    if(len >= 32) {
+        uint64_t v[4] = { h, h + STR_P2, h - STR_P1, h ^ STR_P2 };
+
+        for(; end - p >= 32; p += 32) {
+            v[0] = str_round(v[0], str_load(p));
+            v[1] = str_round(v[1], str_load(p + 8));
+            v[2] = str_round(v[2], str_load(p + 16));
+            v[3] = str_round(v[3], str_load(p + 24));
+        }
+
+        h = str_rotl(v[0], 1) + str_rotl(v[1], 7) +
+            str_rotl(v[2], 12) + str_rotl(v[3], 18);
+    }
+
+    for(; end - p >= 8; p += 8)
+        h = str_round(h, str_load(p));
+
+    /*
+     * Whatever is left over is zero-padded into one last word.
+     */
+    if(p < end) {
+        w = 0;
+        memcpy(&w, p, end - p);
+        h = str_round(h, w);
+    }
+
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+
+    return (size_t) (h ^ (h >> 31));
+}
+
+/*
+ * int str_cmp_buf(const char *a, const char *b, size_t len)
+ * Compare len bytes the way memcmp does. The bulk of the work is done
+ * sixteen bytes at a time with SSE2 where it's available and eight
+ * bytes at a time otherwise; only the block holding the first
+ * difference is looked at byte by byte.
+ */
+int str_cmp_buf(const char *a, const char *b, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    for(; len - i >= 16; i += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) (a + i)),
+                y = _mm_loadu_si128((const __m128i *) (b + i));
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+
+        if(mask != 0xffff) {
+            i += __builtin_ctz(~mask);
+            return (int) (unsigned char) a[i] - (int) (unsigned char) b[i];
+        }
+    }
+#endif
+
+    for(; len - i >= 8; i += 8)
+        if(str_load(a + i) != str_load(b + i))
+            break;
+
+    for(; i < len; i++)
+        if(a[i] != b[i])
+            return (int) (unsigned char) a[i] - (int) (unsigned char) b[i];
+
+    return 0;
+}
+
+/*
+ * static size_t str_intern_find(const char *buf, size_t len, size_t hash)
+ * Return the slot holding the string, or the empty slot where it belongs.
+ * The table must have at least one empty slot.
+ */
+static size_t str_intern_find(const char *buf, size_t len, size_t hash)
+{
+    size_t mask = str_interned.max - 1, i = hash & mask;
+    struct str_intern_s *e;
+
+    for(; (e = str_interned.slots[i]); i = (i + 1) & mask)
+        if(e->hash == hash && e->len == len && !memcmp(e->buf, buf, len))
+            break;
+
+    return i;
+}
+
+static bool str_intern_grow(void)
+{
+    size_t i, max = str_interned.max ? str_interned.max << 1 : STR_INTERN_MIN;
+    struct str_intern_s **old = str_interned.slots,
+        **slots = (struct str_intern_s **)
+        node_mem_alloc(&node_allocator_heap, max * sizeof(*slots));
+    if(!slots)
+        return false;
+
+    memset(slots, 0, max * sizeof(*slots));
+
+    str_interned.slots = slots;
+    str_interned.max = max;
+
+    for(i = 0; old && i < (max >> 1); i++)
+        if(old[i])
+            slots[str_intern_find(old[i]->buf, old[i]->len, old[i]->hash)] =
+                old[i];
+
+    node_mem_free(&node_allocator_heap, old, (max >> 1) * sizeof(*slots));
+    return true;
+}
+
+/*
+ * static struct str_intern_s *str_intern_get(const char *buf, size_t len)
+ * Look up the entry for the string, creating it if necessary, and take
+ * a reference to it. The caller must hold the lock.
+ */
+static struct str_intern_s *str_intern_get(const char *buf, size_t len)
+{
+    size_t hash = str_hash_buf(buf, len), i;
+    struct str_intern_s *e;
+
+    /*
+     * Keep the table at most half full.
+     */
+    if((str_interned.len + 1) << 1 > str_interned.max && !str_intern_grow())
+        return 0;
+
+    i = str_intern_find(buf, len, hash);
+    if((e = str_interned.slots[i])) {
+        e->refs++;
+        return e;
+    }
+
+    if(!(e = (struct str_intern_s *)
+        node_mem_alloc(&node_allocator_heap, sizeof(*e) + len + 1)))
+        return 0;
+
+    e->refs = 1;
+    e->len = len;
+    e->hash = hash;
+    memcpy(e->buf, buf, len);
+    e->buf[len] = 0;
+
+    str_interned.slots[i] = e;
+    str_interned.len++;
+
+    return e;
+}
+
+/*
+ * static char *str_intern(const char *buf, size_t len)
+ * Return the shared buffer for the string.
+ */
+static char *str_intern(const char *buf, size_t len)
+{
+    pthread_mutex_lock(&str_interned.lock);
+    struct str_intern_s *e = str_intern_get(buf, len);
+    pthread_mutex_unlock(&str_interned.lock);
+
+    return e ? e->buf : 0;
+}
+
+/*
+ * static void str_unintern(char *buf)
+ * Drop a reference to a shared buffer, freeing it along with its
+ * slot once nobody refers to it any longer.
+ */
+static void str_unintern(char *buf)
 {
-    if(!data)
+    struct str_intern_s *e = str_intern_entry(buf);
+
+    pthread_mutex_lock(&str_interned.lock);
+
+    if(--e->refs) {
+        pthread_mutex_unlock(&str_interned.lock);
         return;
+    }
+
+    /*
+     * Backward shift deletion: move up any entries which would no longer
+     * be reachable once this slot is empty.
+     */
+    size_t mask = str_interned.max - 1, i, j, k;
+    i = str_intern_find(e->buf, e->len, e->hash);
+
+    for(j = (i + 1) & mask; str_interned.slots[j]; j = (j + 1) & mask) {
+        k = str_interned.slots[j]->hash & mask;
+        if((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j))) {
+            str_interned.slots[i] = str_interned.slots[j];
+            i = j;
+        }
+    }
+
+    str_interned.slots[i] = 0;
+    str_interned.len--;
 
-    struct str_s *str = str_get(data);
+    pthread_mutex_unlock(&str_interned.lock);
+    node_mem_free(&node_allocator_heap, e, sizeof(*e) + e->len + 1);
+}
+
+/*
+ * void str_intern_enable(bool enable)
+ *  Turn interning on or off for all string nodes created from now on.
+ *
+ * notes:
+ *  - Only strings of at least STR_SSO_SIZE bytes are interned. Short ones
+ *    already take no memory beyond their node.
+ *  - A single string can also be interned on demand with
+ *    str_node_new_interned.
+ *  - Strings being created on other threads at the same time may or may
+ *    not see the change.
+ */
+void str_intern_enable(bool enable)
+{
+    atomic_store_explicit(&str_interned.enabled, enable, memory_order_relaxed);
+}
+
+/*
+ * size_t str_intern_count(void)
+ *  The number of distinct strings currently interned.
+ */
+size_t str_intern_count(void)
+{
+    pthread_mutex_lock(&str_interned.lock);
+    size_t len = str_interned.len;
+    pthread_mutex_unlock(&str_interned.lock);
 
-    if(!str->len)
+    return len;
+}
+
+static void str_clear(void *data, const struct node_allocator_s *a)
+{
+    if(!data || (str_at(data, flags) & STR_INLINE))
         return;
 
-    free(str->buf);
-    free(data);
+    if(str_at(data, flags) & STR_INTERNED)
+        str_unintern(str_at(data, buf));
+    else
+        node_mem_free(a, str_at(data, buf), str_len(data) + 1);
 }
 
-static void *str_new(const void *init)
+static bool str_set(void *data, const void *init,
+    const struct node_allocator_s *a)
 {
-    unsigned len = strlen(str_buf(init));
+    size_t len = str_len(init);
     if(!len)
-        return 0;
+        return false;
 
-    struct str_s *new = (struct str_s *) malloc(sizeof(struct str_s));
-    if(!new)
-        return 0;
+    struct str_s *new = str_get(data);
+    char *buf;
 
-    new->buf = (char *) malloc(sizeof(char) * len + 1);
-    if(!new->buf) {
-        free(new);
-        return 0;
+    /*
+     * Short strings live in the str_s itself.
+     */
+    if(len < STR_SSO_SIZE) {
+        new->flags = STR_INLINE;
+        buf = new->sso;
+    } else if((str_at(init, flags) & STR_INTERNED) ||
+        atomic_load_explicit(&str_interned.enabled, memory_order_relaxed)) {
+        /*
+         * Interned strings share a buffer, so there's nothing to copy.
+         */
+        new->flags = STR_INTERNED;
+        new->len = len;
+        new->buf = str_intern(str_buf(init), len);
+        return new->buf != 0;
+    } else {
+        new->flags = 0;
+        buf = new->buf = (char *) node_mem_alloc(a, sizeof(char) * len + 1);
+        if(!buf)
+            return false;
     }
 
-    snprintf(new->buf, len + 1, "%s", str_buf(init));
+    /*
+     * Copy exactly len bytes so that binary strings survive intact,
+     * but keep a terminator around for the convenience of C callers.
+     */
+    memcpy(buf, str_buf(init), len);
+    buf[len] = 0;
     new->len = len;
 
-    return (void *) new;
+    return true;
 }
 
 static struct node_s *to_str(const void *data)
@@ -42,26 +359,67 @@ static struct node_s *to_str(const void *data)
         ? (struct node_s *) data : 0;
 }
 
-static int str_diff(const void *a, const void *b)
+static int str_print(const void *data, char *buf, size_t size)
 {
-    if(a == b)
-        return 0;
+    size_t len = str_len(data);
+
+    if(size) {
+        size_t n = MIN(len, size - 1);
+        memcpy(buf, str_buf(data), n);
+        buf[n] = 0;
+    }
 
-    if(!a || !b)
-        return -1;
+    return (int) len;
+}
+
+/*
+ * Strings are saved with their terminator, so that a loaded file can
+ * hand them out as C strings without copying them.
+ */
+static size_t str_serialize(const void *data, void *buf, size_t size)
+{
+    size_t len = str_len(data);
 
-    if(str_len(a) != str_len(b))
-        return -1;
+    if(size > len) {
+        memcpy(buf, str_buf(data), len);
+        ((char *) buf)[len] = 0;
+    }
+
+    return len + 1;
+}
+
+static bool str_deserialize(void *data, const void *buf, size_t size,
+    const struct node_allocator_s *a)
+{
+    return str_set(data, str_init(buf, size - 1), a);
+}
+
+static int str_diff(const void *a, const void *b)
+{
+    return str_data_diff(a, b);
+}
+
+static size_t str_hash(const void *data)
+{
+    /*
+     * Interned strings were hashed when they were first interned.
+     */
+    if(str_at(data, flags) & STR_INTERNED)
+        return str_intern_entry(str_at(data, buf))->hash;
 
-    return strncmp(str_buf(a), str_buf(b), str_len(a));
+    return str_hash_buf(str_buf(data), str_len(data));
 }
 
 static const struct node_type_s _type_str = {
     .size = sizeof(struct str_s),
-    .freev = str_free,
-    .new = str_new,
+    .init = str_set,
+    .fini = str_clear,
     .diff = str_diff,
+    .hash = str_hash,
     .to_str = to_str,
+    .print = str_print,
+    .serialize = str_serialize,
+    .deserialize = str_deserialize,
     .name = "string"
 };
 
@@ -5,18 +5,24 @@
 // test_summarize(&name##_tr); \//
 #define test_func(name) static void test_##name (struct test_result_s *res)
 #define test_run(name) struct test_result_s name##_tr = test_result_new(#name); \
+    test_start(&name##_tr); \
     test_##name(&name##_tr); \
+    test_stop(&name##_tr); \
     test_pass_round(name##_tr, #name); \
     global_tr.passed += name##_tr.passed; \
-    global_tr.failed += name##_tr.failed
+    global_tr.failed += name##_tr.failed; \
+    global_tr.allocs += name##_tr.allocs; \
+    global_tr.peak = MAX(global_tr.peak, name##_tr.peak)
 
 static void test_summarize(struct test_result_s *sum)
 {
     unsigned total = sum->passed + sum->failed;
     sum->rate = ((float) sum->passed / (float) total) * 100;
     printf("\n%s test results:\n", sum->name);
-    printf("%u tests. %u passed. %u failed. %.02f%% pass rate.\n\n",
+    printf("%u tests. %u passed. %u failed. %.02f%% pass rate.\n",
         total, sum->passed, sum->failed, sum->rate);
+    printf("%.2f ms. %lu node allocations. %lld bytes peak.\n\n",
+        sum->ms, sum->allocs, sum->peak);
 }
 
 static struct node_s *random_str_graph(unsigned num_verts, const char *name)
@@ -154,6 +160,206 @@ test_func(queue)
     test_try(i != TEST_ROUNDS, "expected %d items. Had %lu", TEST_ROUNDS, i);
 
     test_try(q, "queue shouldn't exist");
+
+    /*
+     * A queue drained between items takes over the stack it left behind.
+     */
+    next = str_node_new("qqq");
+    q_en(&q, next);
+    struct node_s *spare = q;
+    q_de(&q);
+    q_en(&q, next);
+    test_try(q != spare, "drained queue wasn't reused");
+    test_try(q_de(&q) != next || q, "reused queue is wrong");
+    node_free_all(next);
+}
+
+test_func(deque)
+{
+    const unsigned num_items = 100;
+    struct node_s *d = 0, *items[num_items], *n;
+    unsigned i;
+
+    for(i = 0; i < num_items; i++)
+        test_fail(!(items[i] = int_node_new(i)), "couldn't create item %u", i);
+
+    /*
+     * Grow the ring while it wraps around: even items go on top,
+     * odd items underneath.
+     */
+    for(i = 0; i < num_items; i++) {
+        if(i & 1)
+            stack_unshift(&d, items[i]);
+        else
+            stack_push(&d, items[i]);
+    }
+
+    test_fail(stack_len(d) != num_items, "deque has %lu items", stack_len(d));
+    test_try(items[0]->owner, "pushing changed an item's owner");
+
+    for(i = num_items - 1; i < num_items; i -= 2)
+        test_break(q_de(&d) != items[i], "wrong bottom item %u", i);
+
+    for(i = num_items - 2; i < num_items; i -= 2)
+        test_break(stack_pop(&d) != items[i], "wrong top item %u", i);
+
+    test_try(d, "empty deque still exists");
+
+    /*
+     * Keep a small queue cycling through a large number of items.
+     */
+    for(i = 0; i < 4; i++)
+        q_en(&d, items[i]);
+
+    for(i = 4; i < num_items; i++) {
+        q_en(&d, items[i]);
+        test_break((n = q_de(&d)) != items[i - 4], "wrong item %u", i);
+    }
+
+    test_try(!d || stack_get(d->data)->max != 8, "queue ring grew");
+    while(q_de(&d))
+        ;
+
+    for(i = 0; i < num_items; i++)
+        node_free_all(items[i]);
+}
+
+#define LFQ_THREADS 2
+#define LFQ_ITEMS 10000
+
+static struct node_s *lfq_items[LFQ_THREADS * LFQ_ITEMS];
+static atomic_uint lfq_seen[LFQ_THREADS * LFQ_ITEMS], lfq_taken;
+
+static void *lfq_producer(void *arg)
+{
+    struct lfq_s *q = (struct lfq_s *) arg;
+    static atomic_uint next;
+    unsigned i, n;
+
+    for(i = 0; i < LFQ_ITEMS; i++) {
+        n = atomic_fetch_add(&next, 1) % (LFQ_THREADS * LFQ_ITEMS);
+        while(!lfq_en(q, lfq_items[n]))
+            sched_yield();
+    }
+
+    return 0;
+}
+
+static void *lfq_consumer(void *arg)
+{
+    struct lfq_s *q = (struct lfq_s *) arg;
+    struct node_s *n;
+
+    while(atomic_load(&lfq_taken) < LFQ_THREADS * LFQ_ITEMS) {
+        if((n = lfq_de(q))) {
+            atomic_fetch_add(&lfq_seen[int_node_n(n)], 1);
+            atomic_fetch_add(&lfq_taken, 1);
+        } else {
+            sched_yield();
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * The single producer for the spsc queue, which hands over every item in
+ * order.
+ */
+static void *spsc_producer(void *arg)
+{
+    struct spsc_s *q = (struct spsc_s *) arg;
+    unsigned i;
+
+    for(i = 0; i < LFQ_THREADS * LFQ_ITEMS; i++)
+        while(!spsc_en(q, lfq_items[i]))
+            sched_yield();
+
+    return 0;
+}
+
+test_func(lfq)
+{
+    const unsigned num_items = LFQ_THREADS * LFQ_ITEMS;
+    pthread_t producers[LFQ_THREADS], consumers[LFQ_THREADS];
+    struct lfq_s *q = lfq_new(100);
+    struct spsc_s *sq = spsc_new(100);
+    struct node_s *n;
+    unsigned i, wrong;
+
+    test_fail(!q || !sq, "couldn't create queues");
+
+    for(i = 0; i < num_items; i++) {
+        lfq_items[i] = int_node_new(i);
+        atomic_init(&lfq_seen[i], 0);
+    }
+
+    /*
+     * Single-threaded semantics: first in, first out, bounded.
+     */
+    for(i = 0; lfq_en(q, lfq_items[i]); i++)
+        ;
+
+    test_try(i != 128, "queue held %u items", i);
+    for(i = 0; i < 128; i++)
+        test_break(lfq_de(q) != lfq_items[i], "wrong item %u", i);
+
+    test_try(lfq_de(q), "empty queue returned an item");
+
+    for(i = 0; spsc_en(sq, lfq_items[i]); i++)
+        ;
+
+    test_try(i != 128, "spsc queue held %u items", i);
+    for(i = 0; i < 128; i++)
+        test_break(spsc_de(sq) != lfq_items[i], "wrong spsc item %u", i);
+
+    test_try(spsc_de(sq), "empty spsc queue returned an item");
+
+    /*
+     * Every item must come out exactly once, whatever the interleaving.
+     */
+    atomic_init(&lfq_taken, 0);
+    for(i = 0; i < LFQ_THREADS; i++) {
+        pthread_create(&consumers[i], 0, lfq_consumer, q);
+        pthread_create(&producers[i], 0, lfq_producer, q);
+    }
+
+    for(i = 0; i < LFQ_THREADS; i++) {
+        pthread_join(producers[i], 0);
+        pthread_join(consumers[i], 0);
+    }
+
+    for(i = 0; i < num_items; i++)
+        if(atomic_load(&lfq_seen[i]) != 1)
+            break;
+
+    test_try(i != num_items, "item %u came out %u times", i,
+        atomic_load(&lfq_seen[i % num_items]));
+    test_try(lfq_de(q), "drained queue returned an item");
+
+    /*
+     * With one producer thread and this thread consuming, the spsc queue
+     * must hand over every item once and in order, though it wraps
+     * around many times.
+     */
+    pthread_create(&producers[0], 0, spsc_producer, sq);
+
+    for(i = 0, wrong = 0; i < num_items;) {
+        if((n = spsc_de(sq)))
+            wrong += n != lfq_items[i++];
+        else
+            sched_yield();
+    }
+
+    pthread_join(producers[0], 0);
+    test_try(wrong, "%u spsc items came out of order", wrong);
+    test_try(spsc_de(sq), "drained spsc queue returned an item");
+
+    for(i = 0; i < num_items; i++)
+        node_free_all(lfq_items[i]);
+
+    lfq_free(q);
+    spsc_free(sq);
 }
 
 test_func(graph)
@@ -172,6 +378,144 @@ test_func(graph)
 static int prev_int;
 static bool fail_flag;
 
+test_func(frozen)
+{
+    const size_t num_verts = 1 << 15, block = 64;
+    struct node_s *g = int_node_new(0), *v, *outside = int_node_new(-1);
+    struct graph_s *f;
+    size_t *dist = (size_t *) malloc(sizeof(size_t) * num_verts),
+        *pdist = (size_t *) malloc(sizeof(size_t) * num_verts),
+        *order = (size_t *) malloc(sizeof(size_t) * num_verts),
+        i, j, *e, reached, edges = 0;
+
+    test_fail(!g || !outside || !dist || !pdist || !order,
+        "couldn't create graph");
+
+    for(i = 0; i < num_verts; i++)
+        node_push(g, int_node_new((int) i));
+
+    /*
+     * Random edges, a child which isn't an edge and an edge which leads
+     * out of the graph. Only the first kind should make it into the
+     * snapshot.
+     */
+    for(i = 0; i < num_verts; i++) {
+        v = node_at(g, i);
+        for(j = 0; j < 3; j++, edges++)
+            node_graph_connect(v, node_at(g, ur(num_verts - 1)));
+
+        if(!(i % 100)) {
+            node_push(v, int_node_new(0));
+            node_graph_connect(v, outside);
+        }
+    }
+
+    f = node_graph_freeze(g);
+    test_fail(!f, "couldn't freeze graph");
+    test_try(f->nverts != num_verts, "snapshot has %lu vertices", f->nverts);
+    test_try(f->nedges != edges, "snapshot has %lu edges, not %lu",
+        f->nedges, edges);
+
+    for(i = 0, fail_flag = false; i < num_verts; i++) {
+        v = node_at(g, i);
+        if(f->verts[i] != v || graph_degree(f, i) < 3)
+            fail_flag = true;
+
+        for(j = 0, e = graph_neighbors(f, i); j < 3; j++)
+            if(node_data(node_at(v, j)) != node_at(g, e[j]))
+                fail_flag = true;
+    }
+
+    test_try(fail_flag, "snapshot doesn't match the graph");
+
+    /*
+     * Every reached vertex must be one edge further away than its
+     * closest neighbor pointing at it, which is what makes it a BFS.
+     */
+    reached = graph_bfs(f, 0, dist);
+    test_try(!reached || dist[0], "bfs didn't start at the source");
+
+    for(i = 0, fail_flag = false; i < num_verts; i++) {
+        if(dist[i] == GRAPH_NONE)
+            continue;
+
+        for(j = 0, e = graph_neighbors(f, i); j < graph_degree(f, i); j++)
+            if(dist[e[j]] > dist[i] + 1)
+                fail_flag = true;
+
+        pdist[i] = dist[i];
+    }
+
+    for(i = 0; i < num_verts; i++)
+        for(j = 0, e = graph_neighbors(f, i); j < graph_degree(f, i); j++)
+            if(dist[i] != GRAPH_NONE && pdist[e[j]] == dist[i] + 1)
+                pdist[e[j]] = GRAPH_NONE;
+
+    for(i = 1; i < num_verts; i++)
+        if(dist[i] != GRAPH_NONE && pdist[i] != GRAPH_NONE)
+            fail_flag = true;
+
+    test_try(fail_flag, "bfs distances are wrong");
+
+    test_try(graph_bfs_parallel(f, 0, pdist, 4) != reached,
+        "parallel bfs reached a different number of vertices");
+    test_try(memcmp(dist, pdist, sizeof(size_t) * num_verts),
+        "parallel bfs distances differ");
+
+    test_try(graph_dfs(f, 0, order) != reached,
+        "dfs reached a different number of vertices");
+
+    /*
+     * The dfs numbers have to be a permutation of the reached vertices.
+     */
+    memset(pdist, 0, sizeof(size_t) * num_verts);
+    for(i = 0, fail_flag = false; i < num_verts; i++) {
+        if((order[i] == GRAPH_NONE) != (dist[i] == GRAPH_NONE))
+            fail_flag = true;
+        else if(order[i] != GRAPH_NONE && pdist[order[i]]++)
+            fail_flag = true;
+    }
+
+    test_try(fail_flag, "dfs order is wrong");
+    graph_free(f);
+
+    /*
+     * Components: chains of block vertices, with random edges within
+     * each block in either direction.
+     */
+    for(i = 0; i < num_verts; i++)
+        node_free_all(node_release(g, i));
+
+    for(i = 0; i < num_verts; i++)
+        node_push(g, int_node_new((int) i));
+
+    for(i = 0; i < num_verts; i++) {
+        if((i + 1) % block)
+            node_graph_connect(node_at(g, i + 1), node_at(g, i));
+
+        node_graph_connect(node_at(g, i),
+            node_at(g, i - i % block + ur(block - 1)));
+    }
+
+    f = node_graph_freeze(g);
+    test_fail(!f, "couldn't freeze graph");
+    test_try(graph_components(f, order) != num_verts / block,
+        "wrong number of components");
+
+    for(i = 0, fail_flag = false; i < num_verts; i++)
+        if(order[i] != i / block)
+            fail_flag = true;
+
+    test_try(fail_flag, "vertices are in the wrong components");
+
+    graph_free(f);
+    node_free_all(g);
+    node_free_all(outside);
+    free(dist);
+    free(pdist);
+    free(order);
+}
+
 static void confirm_ascended(struct node_s *n)
 {
     if(int_node_n(n) < prev_int)
@@ -181,6 +525,404 @@ static void confirm_ascended(struct node_s *n)
     prev_int = int_node_n(n);
 }
 
+/*
+ * The Manhattan distance between two cells of the grid in the paths test,
+ * where each vertex holds its cell's number. Edges weigh at least 1, so
+ * it never overestimates.
+ */
+static double grid_distance(const struct node_s *a, const struct node_s *b,
+    void *width)
+{
+    int w = *(int *) width, x = int_node_n(a), y = int_node_n(b);
+
+    return abs(x % w - y % w) + abs(x / w - y / w);
+}
+
+test_func(paths)
+{
+    int width = 100, cells = width * width, x, y;
+    struct node_s *g = int_node_new(0), *e,
+        **nodes = (struct node_s **) malloc(sizeof(struct node_s *) * (cells + 1));
+    struct graph_s *f;
+    double *dist = (double *) malloc(sizeof(double) * (cells + 1)), cost, sum;
+    size_t *prev = (size_t *) malloc(sizeof(size_t) * (cells + 1)),
+        *path = (size_t *) malloc(sizeof(size_t) * (cells + 1)),
+        i, j, k, len;
+
+    test_fail(!g || !nodes || !dist || !prev || !path, "couldn't create grid");
+
+    /*
+     * A grid with randomly weighted edges between neighboring cells, and
+     * one cell off on its own.
+     */
+    for(i = 0; i <= (size_t) cells; i++)
+        node_push(g, int_node_new((int) i));
+
+    for(y = 0; y < width; y++) {
+        for(x = 0; x < width; x++) {
+            struct node_s *v = node_at(g, y * width + x);
+
+            if(x)
+                node_push(v, edge_node_new(node_at(g, y * width + x - 1), 1 + ur(9)));
+            if(x < width - 1)
+                node_push(v, edge_node_new(node_at(g, y * width + x + 1), 1 + ur(9)));
+            if(y)
+                node_push(v, edge_node_new(node_at(g, (y - 1) * width + x), 1 + ur(9)));
+            if(y < width - 1)
+                node_push(v, edge_node_new(node_at(g, (y + 1) * width + x), 1 + ur(9)));
+        }
+    }
+
+    e = edge_node_new(g, 2.5);
+    test_fail(!e, "couldn't create edge");
+    test_try(edge_node_to(e) != g || edge_node_weight(e) != 2.5,
+        "edge has the wrong data");
+    node_free_all(e);
+
+    f = node_graph_freeze(g);
+    test_fail(!f, "couldn't freeze grid");
+
+    test_try(graph_dijkstra(f, 0, dist, prev) != (size_t) cells,
+        "dijkstra reached the wrong number of vertices");
+    test_try(dist[cells] != INFINITY || prev[cells] != GRAPH_NONE,
+        "dijkstra reached the lone vertex");
+
+    /*
+     * No edge may lead somewhere shorter than dist says, and every vertex
+     * has to be reached through the edge from prev.
+     */
+    for(i = 0, fail_flag = false; i < (size_t) cells; i++) {
+        for(k = f->offsets[i]; k < f->offsets[i + 1]; k++)
+            if(dist[f->targets[k]] > dist[i] + f->weights[k])
+                fail_flag = true;
+
+        if(!i)
+            continue;
+
+        for(k = f->offsets[prev[i]]; k < f->offsets[prev[i] + 1]; k++)
+            if(f->targets[k] == i && dist[prev[i]] + f->weights[k] == dist[i])
+                break;
+
+        if(k == f->offsets[prev[i] + 1])
+            fail_flag = true;
+    }
+
+    test_try(fail_flag, "dijkstra distances are wrong");
+
+    for(j = 0; j < 10; j++) {
+        i = ur(cells - 1);
+        len = graph_astar(f, 0, i, grid_distance, &width, path, &cost);
+
+        test_try(!len || path[0] || path[len - 1] != i, "a* path is wrong");
+        test_try(cost != dist[i], "a* found a path of %g, not %g",
+            cost, dist[i]);
+
+        for(k = 1, sum = 0; k < len; k++) {
+            size_t *t = graph_neighbors(f, path[k - 1]);
+
+            for(x = 0; x < (int) graph_degree(f, path[k - 1]); x++)
+                if(t[x] == path[k])
+                    break;
+
+            sum += f->weights[f->offsets[path[k - 1]] + x];
+        }
+
+        test_try(sum != cost, "a* path costs %g, not %g", sum, cost);
+
+        test_try(!graph_astar(f, 0, i, 0, 0, path, &sum) || sum != cost,
+            "a* without a heuristic found a longer path");
+
+        test_try(node_graph_path(f, node_at(g, 0), node_at(g, i),
+            grid_distance, &width, nodes, &sum) != len || sum != cost ||
+            nodes[len - 1] != node_at(g, i),
+            "node_graph_path found a different path");
+    }
+
+    test_try(graph_astar(f, 0, cells, grid_distance, &width, path, &cost),
+        "a* found a path to the lone vertex");
+    test_try(graph_astar(f, 5, 5, 0, 0, path, &cost) != 1 || cost,
+        "a* path to the source isn't empty");
+    test_try(node_graph_path(f, node_at(g, 0), g, 0, 0, nodes, &cost),
+        "node_graph_path took a node from outside the graph");
+
+    graph_free(f);
+    node_free_all(g);
+    free(nodes);
+    free(dist);
+    free(prev);
+    free(path);
+}
+
+/*
+ * Check that two nodes hold the same things, comparing edges by where
+ * they lead rather than by pointer.
+ */
+static bool same_nodes(const struct node_s *a, const struct node_s *b)
+{
+    size_t i;
+
+    if(!a || !b)
+        return a == b;
+
+    if(a->type != b->type || a->len != b->len || a->count != b->count ||
+        a->height != b->height)
+        return false;
+
+    if(a->type == node_type_edge) {
+        if(edge_node_weight(a) != edge_node_weight(b) ||
+            node_diff(edge_node_to(a), edge_node_to(b)))
+            return false;
+    } else if(node_diff(a, b)) {
+        return false;
+    }
+
+    for(i = 0; i < a->len; i++)
+        if(!same_nodes(a->table[i], b->table[i]))
+            return false;
+
+    return true;
+}
+
+test_func(serial)
+{
+    char path[] = "/tmp/node_test_XXXXXX", buf[200];
+    struct node_s *root = str_node_new("root"), *tree = 0, *g = int_node_new(0),
+        *l, *m;
+    struct graph_s *f, *f2;
+    struct node_view_s *v;
+    size_t i;
+    int fd = mkstemp(path);
+
+    test_fail(fd < 0 || !root || !g, "couldn't create test file");
+    close(fd);
+
+    /*
+     * Strings short and long, a gap, a balanced tree, a weighted graph
+     * and a nested node holding a node of its own.
+     */
+    node_push(root, str_node_new("a string long enough not to be inline"));
+    node_put(root, 3, int_node_new(-42));
+
+    for(i = 0; i < 1000; i++)
+        node_avl_insert(&tree, int_node_new((int) ur(100000)));
+
+    node_push(root, tree);
+
+    for(i = 0; i < 200; i++) {
+        snprintf(buf, sizeof(buf), "vertex %lu", i);
+        node_push(g, str_node_new(buf));
+    }
+
+    for(i = 0; i < 1000; i++) {
+        m = node_at(g, ur(199));
+        if(i & 1)
+            node_push(m, edge_node_new(node_at(g, ur(199)), ur(1000) / 10.0));
+        else
+            node_graph_connect(m, node_at(g, ur(199)));
+    }
+
+    node_push(root, g);
+    node_push(root, node_new_node(str_node_new("held by a nested node")));
+
+    test_try(!node_save(root, path), "couldn't save nodes");
+
+    l = node_load(path);
+    test_fail(!l, "couldn't load nodes");
+    test_try(!same_nodes(root, l), "loaded nodes differ");
+    test_try(node_data(node_at(l, 6)) == node_data(node_at(root, 6)),
+        "loaded nested node points at the original");
+
+    m = node_avl_find(node_at(l, 4), node_at(tree, 0));
+    test_try(!m || node_diff(m, node_at(tree, 0)),
+        "couldn't find a value in the loaded tree");
+    test_try(node_bst_rank(node_at(l, 4), m) != node_bst_rank(tree,
+        node_at(tree, 0)), "loaded tree has the wrong ranks");
+
+    f = node_graph_freeze(g);
+    f2 = node_graph_freeze(node_at(l, 5));
+    test_fail(!f || !f2, "couldn't freeze graphs");
+    test_try(f->nedges != 1000 || f2->nedges != 1000,
+        "graphs have %lu and %lu edges", f->nedges, f2->nedges);
+    test_try(memcmp(f->offsets, f2->offsets, sizeof(size_t) * 201) ||
+        memcmp(f->targets, f2->targets, sizeof(size_t) * 1000) ||
+        memcmp(f->weights, f2->weights, sizeof(double) * 1000),
+        "loaded graph has different edges");
+    graph_free(f);
+    graph_free(f2);
+    node_free_all(l);
+
+    /*
+     * The view reads the same file in place.
+     */
+    v = node_view_open(path);
+    test_fail(!v, "couldn't open view");
+    test_try(node_view_type(v, 0) != node_type_str ||
+        strcmp((const char *) node_view_data(v, 0), "root"),
+        "view has the wrong root");
+    test_try(node_view_children(v, 0) != 7 ||
+        node_view_child(v, 0, 2) != NODE_FILE_NONE,
+        "view has the wrong children");
+
+    i = node_view_child(v, 0, 3);
+    test_try(node_view_type(v, i) != node_type_int ||
+        *(const int *) node_view_data(v, i) != -42,
+        "view has the wrong integer");
+
+    i = node_view_child(v, 0, 6);
+    test_try(node_view_type(v, i) != node_type_node ||
+        strcmp((const char *) node_view_data(v, node_view_ref(v, i)),
+        "held by a nested node"), "view has the wrong nested node");
+    node_view_close(v);
+
+    /*
+     * Things which can't be saved, and files which can't be loaded.
+     */
+    m = map_node_new();
+    node_push(root, m);
+    test_try(node_save(root, path), "saved a map");
+    node_free_all(node_pop(root));
+
+    l = int_node_new(0);
+    node_push(root, edge_node_new(l, 1));
+    test_try(node_save(root, path), "saved an edge leading outside");
+    node_free_all(node_pop(root));
+    node_free_all(l);
+
+    test_try(!node_save(root, path), "couldn't save nodes again");
+    test_try(truncate(path, 100) || node_load(path) || node_view_open(path),
+        "loaded a truncated file");
+    test_try(node_load("/nonexistent/node/file"), "loaded a missing file");
+
+    unlink(path);
+    node_free_all(root);
+}
+
+test_func(import)
+{
+    const unsigned num_labels = 5000, num_lines = 50000;
+    char path[] = "/tmp/node_test_XXXXXX";
+    struct node_import_s o = { .weighted = true };
+    struct node_s *g, *p, *v, *m;
+    struct graph_s *f, *f2;
+    unsigned *from = (unsigned *) malloc(sizeof(unsigned) * num_lines),
+        *to = (unsigned *) malloc(sizeof(unsigned) * num_lines), i;
+    size_t *vert = (size_t *) calloc(num_labels, sizeof(size_t)),
+        *next = (size_t *) calloc(num_labels, sizeof(size_t)), j, k;
+    int fd = mkstemp(path);
+    FILE *out = fd < 0 ? 0 : fdopen(fd, "w");
+
+    test_fail(!out || !from || !to || !vert || !next,
+        "couldn't create test file");
+
+    /*
+     * Enough lines to take more than one chunk, with comments, blank
+     * lines, lines with too few fields, line ends of both kinds and no
+     * line end at all at the end.
+     */
+    fprintf(out, "# an edge list\n\nlonely\n");
+    for(i = 0; i < num_lines; i++) {
+        from[i] = ur(num_labels - 1);
+        to[i] = ur(num_labels - 1);
+        fprintf(out, "vertex%u\t vertex%u %u%s", from[i], to[i], i % 10,
+            i == num_lines - 1 ? "" : i & 1 ? "\r\n" : "\n");
+    }
+    fclose(out);
+
+    g = node_import_graph(path, &o);
+    test_fail(!g, "couldn't import graph");
+    test_try(strcmp(str_node_buf(g), path), "graph isn't named after the file");
+
+    f = node_graph_freeze(g);
+    test_fail(!f, "couldn't freeze graph");
+    test_try(f->nedges != num_lines, "imported %lu edges, not %u",
+        f->nedges, num_lines);
+
+    /*
+     * Walk the lines again, checking each vertex's edges in order. The
+     * vertices are found by the number in their label.
+     */
+    for(j = 0; j < f->nverts; j++)
+        vert[atoi(str_node_buf(f->verts[j]) + 6)] = j;
+
+    for(i = 0, fail_flag = false; !fail_flag && i < num_lines; i++) {
+        j = vert[from[i]];
+        v = node_at(f->verts[j], next[j]);
+        next[j]++;
+
+        if(!v || v->type != node_type_edge ||
+            edge_node_to(v) != f->verts[vert[to[i]]] ||
+            edge_node_weight(v) != i % 10)
+            fail_flag = true;
+    }
+
+    test_try(fail_flag, "imported edges are wrong");
+
+    /*
+     * Presizing, in both directions, with no weights.
+     */
+    o.weighted = false;
+    o.undirected = true;
+    o.presize = true;
+    p = node_import_graph(path, &o);
+    test_fail(!p, "couldn't import presized graph");
+    f2 = node_graph_freeze(p);
+    test_fail(!f2, "couldn't freeze graph");
+    test_try(f2->nverts != f->nverts, "presized graph has %lu vertices",
+        f2->nverts);
+
+    for(i = 0, k = 0; i < num_lines; i++)
+        k += from[i] == to[i] ? 1 : 2;
+
+    test_try(f2->nedges != k, "undirected graph has %lu edges, not %lu",
+        f2->nedges, k);
+
+    for(j = 0, fail_flag = false; j < f2->nverts; j++)
+        if(node_at(p, j)->max != graph_degree(f2, j) ||
+            node_at(p, j)->table[0]->type != node_type_node)
+            fail_flag = true;
+
+    test_try(fail_flag, "presized tables are the wrong size");
+
+    graph_free(f);
+    graph_free(f2);
+    node_free_all(g);
+    node_free_all(p);
+
+    /*
+     * A map, with a value which contains spaces and a key which is
+     * given twice.
+     */
+    out = fopen(path, "w");
+    test_fail(!out, "couldn't rewrite test file");
+    fprintf(out, "one\t1\ntwo\ttwo words\nthree\nonce\tmore\none\tagain\n");
+    fclose(out);
+
+    o = (struct node_import_s) { .sep = '\t', .presize = true };
+    m = node_import_map(path, &o);
+    test_fail(!m, "couldn't import map");
+    test_try(map_len(m) != 3, "map has %lu keys", map_len(m));
+
+    v = str_node_new("two");
+    test_try(!node_map_get(m, v) || strcmp(str_node_buf(node_at(
+        node_map_get(m, v), 0)), "two words"), "map value is wrong");
+    node_free_all(v);
+
+    v = str_node_new("one");
+    test_try(!node_map_get(m, v) || strcmp(str_node_buf(node_at(
+        node_map_get(m, v), 0)), "again"), "repeated key wasn't replaced");
+    node_free_all(v);
+    node_free_all(m);
+
+    test_try(node_import_graph("/nonexistent/edges", 0),
+        "imported a missing file");
+
+    unlink(path);
+    free(from);
+    free(to);
+    free(vert);
+    free(next);
+}
+
 test_func(btree)
 {
     const unsigned num_nodes = 200;
@@ -206,21 +948,1327 @@ test_func(btree)
     node_free_all(t);
 }
 
-int main(int argc, char const *argv[])
+test_func(pool)
 {
-    init_random();
-    struct test_result_s global_tr = test_result_new("global");
+    const unsigned num_nodes = 200;
     unsigned i;
 
-    printf("Running %s tests\n", global_tr.name);
-    for(i = 0; i < TEST_ROUNDS; i++) {
-        test_run(basic);
-        test_run(list);
-        test_run(stack);
-        test_run(queue);
-        test_run(graph);
-        test_run(table);
-        test_run(btree);
+    struct node_s *a, *b, *t, *l;
+
+    /*
+     * Everything below is pooled, so bailing out early just means going
+     * straight to the reset, which also leaves the pool disabled for the
+     * tests after this one.
+     */
+    node_pool_enable(true);
+
+    a = int_node_new(1);
+    test_do(!a, goto done, "couldn't create pooled node");
+    test_try(a->alloc != &node_allocator_pool, "node wasn't pooled");
+    node_free_all(a);
+
+    b = int_node_new(2);
+    test_try(a != b, "freed node wasn't reused");
+    test_try(int_node_n(b) != 2, "reused node has the wrong value");
+    node_free_all(b);
+
+    t = int_node_new(num_nodes >> 1);
+    test_do(!t, goto done, "couldn't create root node");
+
+    for(i = 0; i < num_nodes; i++)
+        test_break(!node_bst_insert(t, int_node_new(ur(num_nodes))),
+            "couldn't insert pooled node %u", i);
+
+    prev_int = -1; fail_flag = false;
+    node_in_order(t, confirm_ascended);
+    test_try(fail_flag, "pooled btree is out of order");
+
+    l = int_node_new(0);
+    test_do(!l, goto done, "couldn't create list node");
+    node_push(t, l);
+
+    for(i = 0; i < num_nodes; i++)
+        node_push(l, int_node_new(i));
+
+    test_try(l->len != num_nodes, "pooled table has the wrong length");
+
+    /*
+     * Let the pool take the whole structure down at once.
+     */
+done:
+    node_pool_reset();
+    node_pool_enable(false);
+
+    t = int_node_new(0);
+    test_try(t->alloc != &node_allocator_heap, "node was pooled after disabling the pool");
+    node_free_all(t);
+}
+
+test_func(inline)
+{
+    struct node_s   *a = int_node_new(7),
+                    *b = int_node_new(7),
+                    *s = str_node_new("inline"),
+                    *n = node_new_node(a);
+
+    test_fail(!a || !b || !s || !n, "couldn't create nodes");
+    test_try(a->data != a->inline_data.bytes, "int data isn't inline");
+    test_try(s->data != s->inline_data.bytes, "str data isn't inline");
+    test_try(n->data != a, "nested node data was copied");
+    test_try(node_diff(a, b), "inline ints differ");
+    test_try(strcmp(str_node_buf(s), "inline"), "inline str is wrong");
+
+    node_free_all(n);
+    node_free_all(b);
+    node_free_all(s);
+}
+
+test_func(render)
+{
+    char buf[8];
+    struct node_s   *i = int_node_new(-1234),
+                    *s = str_node_new("rendered"),
+                    *n = node_new_node_const(i);
+
+    test_fail(!i || !s || !n, "couldn't create nodes");
+    test_try(i->str, "int str was built eagerly");
+
+    test_try(node_render(i, buf, sizeof(buf)) != 5, "wrong int length");
+    test_try(strcmp(buf, "-1234"), "int rendered as %s", buf);
+    test_try(i->str, "rendering allocated a str");
+    test_try(node_render(n, buf, sizeof(buf)) != 5, "wrong nested length");
+    test_try(node_render(s, buf, sizeof(buf)) != 8, "wrong str length");
+    test_try(strcmp(buf, "rendere"), "str wasn't truncated: %s", buf);
+
+    test_try(strcmp(node_string(i), "-1234"), "int str is wrong");
+    test_try(!i->str, "int str wasn't cached");
+
+    node_free_all(n);
+    node_free_all(i);
+    node_free_all(s);
+}
+
+test_func(sso)
+{
+    const char bin[] = { 'a', 0, 'b', 0, 'c' };
+    const char *l = "a string which is too long to be stored inline";
+    struct node_s   *s = str_node_new("short"),
+                    *h = str_node_new(l),
+                    *b1 = str_node_new_len(bin, sizeof(bin)),
+                    *b2 = str_node_new_len(bin, sizeof(bin) - 1),
+                    *p = str_node_new_len(l, 6);
+
+    test_fail(!s || !h || !b1 || !b2 || !p, "couldn't create str nodes");
+    test_try(!(str_node_get(s)->flags & STR_INLINE), "short str isn't inline");
+    test_try(str_node_get(h)->flags & STR_INLINE, "long str is inline");
+    test_try(strcmp(str_node_buf(s), "short"), "short str is wrong");
+    test_try(strcmp(str_node_buf(h), l), "long str is wrong");
+    test_try(str_node_len(b1) != sizeof(bin), "binary str has wrong length");
+    test_try(memcmp(str_node_buf(b1), bin, sizeof(bin)), "binary str is wrong");
+    test_try(!node_diff(b1, b2), "binary strs of different length match");
+    test_try(strcmp(str_node_buf(p), "a stri"), "prefix str is wrong");
+
+    node_free_all(s);
+    node_free_all(h);
+    node_free_all(b1);
+    node_free_all(b2);
+    node_free_all(p);
+}
+
+test_func(strcmp)
+{
+    char a[100], b[100];
+    struct node_s *x, *y;
+    unsigned i, la, lb, at;
+    int expect, diff;
+
+    for(i = 0; i < 1000; i++) {
+        /*
+         * Two strings which share a prefix of random length, then
+         * differ in one byte (or in length only).
+         */
+        la = ur(sizeof(a) - 1) + 1;
+        lb = i & 1 ? la : ur(sizeof(b) - 1) + 1;
+        memset(a, 'x', sizeof(a));
+        memset(b, 'x', sizeof(b));
+
+        at = ur(MIN(la, lb) - 1);
+        if(i % 3)
+            b[at] = (char) ur(255);
+
+        x = str_node_new_len(a, la);
+        y = str_node_new_len(b, lb);
+
+        expect = memcmp(a, b, MIN(la, lb));
+        if(!expect)
+            expect = la < lb ? -1 : la > lb;
+
+        diff = node_diff(x, y);
+        test_break((diff < 0) != (expect < 0) || (diff > 0) != (expect > 0),
+            "compared %u and %u bytes differing at %u as %d", la, lb, at, diff);
+
+        test_break(!diff && node_hash(x) != node_hash(y),
+            "equal strings hash differently");
+
+        node_free_all(x);
+        node_free_all(y);
+    }
+
+    /*
+     * Interned and plain copies of a string hash the same.
+     */
+    x = str_node_new_interned("a string long enough to be interned");
+    y = str_node_new("a string long enough to be interned");
+    test_try(node_hash(x) != node_hash(y), "interned string hashes differently");
+    node_free_all(x);
+    node_free_all(y);
+
+    x = int_node_new(-7);
+    y = int_node_new(-7);
+    test_try(node_hash(x) != node_hash(y), "equal integers hash differently");
+    node_free_all(x);
+    node_free_all(y);
+}
+
+test_func(intern)
+{
+    const char *labels[] = {
+        "the first long interned label",
+        "the second long interned label",
+        "the third long interned label"
+    };
+    const unsigned num_labels = sizeof(labels) / sizeof(*labels);
+    unsigned i;
+
+    struct node_s *g = str_node_new("interned"), *a, *b;
+    test_fail(!g, "couldn't create graph node");
+
+    str_intern_enable(true);
+    for(i = 0; i < TEST_ROUNDS * num_labels; i++)
+        test_break(!node_push(g, str_node_new(labels[i % num_labels])),
+            "couldn't add label %u", i);
+    str_intern_enable(false);
+
+    test_try(str_intern_count() != num_labels, "%lu strings interned",
+        str_intern_count());
+
+    a = node_at(g, 0);
+    b = node_at(g, num_labels);
+    test_try(str_node_buf(a) != str_node_buf(b), "buffer isn't shared");
+    test_try(node_diff(a, b), "interned strings differ");
+    test_try(!node_diff(a, node_at(g, 1)), "different strings match");
+
+    a = str_node_new_interned(labels[0]);
+    b = str_node_new(labels[0]);
+    test_try(str_node_buf(a) != str_node_buf(node_at(g, 0)),
+        "explicitly interned buffer isn't shared");
+    test_try(str_node_buf(b) == str_node_buf(a), "uninterned buffer is shared");
+    test_try(node_diff(a, b), "interned and uninterned strings differ");
+
+    node_free_all(g);
+    test_try(str_intern_count() != 1, "freed strings are still interned");
+
+    node_free_all(a);
+    node_free_all(b);
+    test_try(str_intern_count(), "strings are still interned");
+
+    /*
+     * Short strings stay inline rather than being interned.
+     */
+    a = str_node_new_interned("short");
+    test_try(!(str_node_get(a)->flags & STR_INLINE) || str_intern_count(),
+        "short string was interned");
+    node_free_all(a);
+}
+
+/*
+ * Check the AVL invariants and return the height of the tree,
+ * or -1 if they don't hold.
+ */
+static int avl_check(struct node_s *n)
+{
+    if(!n)
+        return 0;
+
+    struct node_s *l = node_at(n, NODE_LEFT), *r = node_at(n, NODE_RIGHT);
+    int hl = avl_check(l), hr = avl_check(r);
+
+    if(hl < 0 || hr < 0 || abs(hl - hr) > 1 || n->height != MAX(hl, hr) + 1)
+        return -1;
+
+    if((l && (l->owner != n || node_diff(l, n) > 0)) ||
+        (r && (r->owner != n || node_diff(r, n) < 0)))
+        return -1;
+
+    return n->height;
+}
+
+/*
+ * Check that every node of an unbalanced tree knows its subtree's size
+ * and height, and return the height, or -1 if any of them is wrong.
+ */
+static int bst_check(struct node_s *n)
+{
+    if(!n)
+        return 0;
+
+    struct node_s *l = node_at(n, NODE_LEFT), *r = node_at(n, NODE_RIGHT);
+    int hl = bst_check(l), hr = bst_check(r);
+
+    if(hl < 0 || hr < 0 || n->height != (size_t) MAX(hl, hr) + 1 ||
+        n->count != node_count(l) + node_count(r) + 1)
+        return -1;
+
+    return n->height;
+}
+
+test_func(avl)
+{
+    const unsigned num_nodes = 1000;
+    struct node_s *t = 0, *n, *key;
+    unsigned i, bits;
+
+    for(i = num_nodes, bits = 0; i; i >>= 1)
+        bits++;
+
+    /*
+     * Sorted input would turn an unbalanced tree into a list.
+     */
+    for(i = 0; i < num_nodes; i++)
+        test_break(!node_avl_insert(&t, int_node_new(i)),
+            "couldn't insert node %u", i);
+
+    test_fail(!t, "couldn't create tree");
+    test_try(avl_check(t) < 0, "tree is unbalanced");
+    test_try(t->height > 1.44 * bits + 1, "tree is too tall");
+
+    prev_int = -1; fail_flag = false;
+    node_in_order(t, confirm_ascended);
+    test_try(fail_flag, "avl tree is out of order");
+
+    for(i = 0; i < num_nodes; i++) {
+        key = int_node_new(i);
+        n = node_avl_find(t, key);
+        node_free_all(key);
+        test_break(!n || int_node_n(n) != i, "couldn't find node %u", i);
+    }
+
+    /*
+     * Remove a random half of the nodes.
+     */
+    for(i = 0; i < num_nodes >> 1; i++) {
+        key = int_node_new(ur(num_nodes));
+        n = node_avl_delete(&t, key);
+        test_try(n && (n->owner || node_at(n, NODE_LEFT) ||
+            node_at(n, NODE_RIGHT)), "removed node %u is still linked", i);
+
+        node_free_all(n);
+        node_free_all(key);
+    }
+
+    test_try(avl_check(t) < 0, "tree is unbalanced after removal");
+
+    prev_int = -1; fail_flag = false;
+    node_in_order(t, confirm_ascended);
+    test_try(fail_flag, "avl tree is out of order after removal");
+
+    /*
+     * Trees kept in another node's table stay attached to it.
+     */
+    struct node_s *o = str_node_new("owner");
+    node_put(o, 3, t);
+
+    for(i = 0; i < num_nodes; i++) {
+        key = int_node_new(i);
+        node_free_all(node_avl_delete(&t, key));
+        node_free_all(key);
+    }
+
+    test_try(t, "tree isn't empty");
+    test_try(node_at(o, 3), "owner still holds the tree");
+
+    t = 0;
+    node_avl_insert(&t, int_node_new(1));
+    node_put(o, 3, t);
+    node_avl_insert(&t, int_node_new(2));
+    node_avl_insert(&t, int_node_new(3));
+    test_try(node_at(o, 3) != t, "owner lost track of the tree");
+    test_try(avl_check(t) != 2, "small tree is unbalanced");
+
+    node_free_all(o);
+}
+
+static unsigned range_visits;
+
+static void count_range(struct node_s *n)
+{
+    confirm_ascended(n);
+    range_visits++;
+}
+
+test_func(order)
+{
+    const unsigned num_nodes = 300;
+    unsigned values[num_nodes + 1], i, j, k;
+    struct node_s *bst = int_node_new(num_nodes >> 1), *avl = 0, *n;
+    test_fail(!bst, "couldn't create root node");
+
+    /*
+     * Count the occurrences of each value, including the root's.
+     */
+    memset(values, 0, sizeof(values));
+    values[num_nodes >> 1]++;
+
+    for(i = 0; i < num_nodes; i++) {
+        k = ur(num_nodes);
+        values[k]++;
+        node_bst_insert(bst, int_node_new(k));
+        node_avl_insert(&avl, int_node_new(k));
+    }
+
+    node_avl_insert(&avl, int_node_new(num_nodes >> 1));
+
+    test_try(bst->count != num_nodes + 1, "bst count is %lu", bst->count);
+    test_try(bst_check(bst) < 0, "bst counts or heights are wrong");
+    test_try(avl->count != num_nodes + 1, "avl count is %lu", avl->count);
+
+    for(i = 0, k = 0; i <= num_nodes; i++) {
+        struct node_s *key = int_node_new(i);
+
+        test_try(node_bst_rank(bst, key) != k, "wrong bst rank for %u", i);
+        test_try(node_bst_rank(avl, key) != k, "wrong avl rank for %u", i);
+
+        for(j = 0; j < values[i]; j++, k++) {
+            n = node_bst_select(bst, k);
+            test_try(!n || int_node_n(n) != i, "wrong bst select for %u", k);
+            n = node_bst_select(avl, k);
+            test_try(!n || int_node_n(n) != i, "wrong avl select for %u", k);
+        }
+
+        node_free_all(key);
+    }
+
+    test_try(node_bst_select(avl, k), "selected beyond the end of the tree");
+
+    /*
+     * Windowed queries.
+     */
+    for(i = 0; i < TEST_ROUNDS; i++) {
+        unsigned lo = ur(num_nodes), hi = lo + ur(num_nodes - lo);
+        struct node_s *l = int_node_new(lo), *h = int_node_new(hi);
+
+        for(j = lo, k = 0; j <= hi; j++)
+            k += values[j];
+
+        prev_int = -1; fail_flag = false; range_visits = 0;
+        test_try(node_bst_range(bst, l, h, count_range) != k,
+            "wrong bst range size for [%u, %u]", lo, hi);
+        test_try(range_visits != k || fail_flag, "bad bst range visit");
+
+        prev_int = -1; fail_flag = false; range_visits = 0;
+        test_try(node_bst_range(avl, l, h, count_range) != k,
+            "wrong avl range size for [%u, %u]", lo, hi);
+        test_try(range_visits != k || fail_flag, "bad avl range visit");
+
+        node_free_all(l);
+        node_free_all(h);
+    }
+
+    node_free_all(bst);
+    node_free_all(avl);
+}
+
+static struct node_s *order_seen[200];
+static unsigned order_len;
+
+static void record_order(struct node_s *n)
+{
+    order_seen[order_len++] = n;
+}
+
+/*
+ * Recursive reference traversal to check the iterators against.
+ */
+static void recurse_order(struct node_s *n, enum node_order_e o)
+{
+    if(!n)
+        return;
+
+    if(o == NODE_PRE_ORDER)
+        record_order(n);
+
+    recurse_order(node_at(n, NODE_LEFT), o);
+
+    if(o == NODE_IN_ORDER)
+        record_order(n);
+
+    recurse_order(node_at(n, NODE_RIGHT), o);
+
+    if(o == NODE_POST_ORDER)
+        record_order(n);
+}
+
+test_func(specialized)
+{
+    const unsigned num_nodes = 500;
+    struct node_s *avl = 0, *bst = int_node_new(num_nodes / 2), *strs = 0,
+        *key, *s;
+    char buf[32];
+    unsigned i;
+
+    for(i = 0; i < num_nodes; i++) {
+        node_avl_insert_int(&avl, int_node_new(ur(num_nodes)));
+        node_bst_insert_int(bst, int_node_new(ur(num_nodes)));
+
+        sprintf(buf, i & 1 ? "%u" : "a long string number %u", ur(num_nodes));
+        node_avl_insert_str(&strs, str_node_new(buf));
+    }
+
+    test_try(avl_check(avl) < 0, "int tree is unbalanced");
+    test_try(avl_check(strs) < 0, "str tree is unbalanced");
+    test_try(bst->count != num_nodes + 1, "bst count is %lu", bst->count);
+
+    fail_flag = false;
+    prev_int = -1;
+    node_in_order(bst, confirm_ascended);
+    test_try(fail_flag, "int bst is out of order");
+
+    /*
+     * The specialized and generic versions agree.
+     */
+    for(i = 0, fail_flag = false; i < num_nodes; i++) {
+        key = int_node_new(i);
+        if(node_avl_find_int(avl, key) != node_avl_find(avl, key) ||
+            node_bst_rank_int(avl, key) != node_bst_rank(avl, key) ||
+            node_bst_rank_int(bst, key) != node_bst_rank(bst, key))
+            fail_flag = true;
+
+        node_free_all(key);
+
+        sprintf(buf, i & 1 ? "%u" : "a long string number %u", i);
+        key = str_node_new(buf);
+        if(node_avl_find_str(strs, key) != node_avl_find(strs, key) ||
+            node_bst_rank_str(strs, key) != node_bst_rank(strs, key))
+            fail_flag = true;
+
+        node_free_all(key);
+    }
+
+    test_try(fail_flag, "specialized and generic searches disagree");
+
+    /*
+     * Nodes of other types are refused.
+     */
+    s = str_node_new("not an int");
+    test_try(node_avl_insert_int(&strs, s), "int insert took a string");
+    test_try(node_avl_find_int(strs, s), "int find searched strings");
+    node_free_all(s);
+
+    key = int_node_new(0);
+    test_try(node_bst_insert_str(bst, key), "str insert took an int");
+    node_free_all(key);
+
+    node_free_all(avl);
+    node_free_all(bst);
+    node_free_all(strs);
+}
+
+test_func(build)
+{
+    const size_t num_nodes = 100000;
+    struct node_s **nodes = (struct node_s **)
+        malloc(sizeof(struct node_s *) * num_nodes), *t, *n;
+    size_t i, j;
+
+    test_fail(!nodes, "couldn't allocate nodes");
+
+    /*
+     * Shuffled input, big enough to be built by several threads.
+     */
+    for(i = 0; i < num_nodes; i++)
+        nodes[i] = int_node_new((int) i);
+
+    for(i = num_nodes - 1; i > 0; i--) {
+        j = ur(i);
+        t = nodes[i];
+        nodes[i] = nodes[j];
+        nodes[j] = t;
+    }
+
+    t = node_bst_build(nodes, num_nodes);
+    test_fail(!t, "couldn't build tree");
+    test_try(avl_check(t) < 0, "built tree is unbalanced");
+    test_try(t->count != num_nodes, "built tree has %lu nodes", t->count);
+    test_try(t->owner, "built tree's root has an owner");
+
+    for(i = 0; i < num_nodes; i += 997) {
+        n = node_bst_select(t, i);
+        test_break(!n || int_node_n(n) != i, "wrong node at %lu", i);
+    }
+
+    i = 0;
+    node_bt_loop(n, t, NODE_IN_ORDER)
+        if(int_node_n(n) != i++)
+            break;
+
+    test_try(n, "tree is out of order at %lu", i - 1);
+
+    /*
+     * The tree can still be modified as an AVL tree.
+     */
+    n = int_node_new(-1);
+    node_avl_insert(&t, n);
+    test_try(node_bst_select(t, 0) != n, "couldn't insert into built tree");
+    node_free_all(node_avl_remove(&t, t));
+    test_try(avl_check(t) < 0, "built tree is unbalanced after removal");
+
+    node_free_all(t);
+
+    /*
+     * Sorted, pooled input taken out of another node's table.
+     */
+    node_pool_enable(true);
+    struct node_s *list = int_node_new(0);
+
+    for(i = 0; i < 1000; i++)
+        node_push(list, int_node_new((int) i));
+
+    for(i = 0; i < 1000; i++)
+        nodes[i] = node_at(list, i);
+
+    t = node_bst_build(nodes, 1000);
+    test_try(!t || avl_check(t) < 0, "pooled tree is unbalanced");
+    test_try(list->len, "nodes weren't released from the list");
+    test_try(node_bst_select(t, 999) != nodes[999], "wrong pooled maximum");
+
+    node_free_all(t);
+    node_free_all(list);
+    node_pool_enable(false);
+    node_pool_reset();
+
+    /*
+     * Mixed types are refused.
+     */
+    nodes[0] = int_node_new(1);
+    nodes[1] = str_node_new("one");
+    test_try(node_bst_build(nodes, 2), "built a tree of mixed types");
+    node_free_all(nodes[0]);
+    node_free_all(nodes[1]);
+
+    free(nodes);
+}
+
+test_func(traverse)
+{
+    const unsigned num_nodes = 200, deep = 100000;
+    struct node_s *t = int_node_new(num_nodes >> 1), *n, *prev;
+    struct node_iter_s it;
+    enum node_order_e o;
+    unsigned i;
+
+    test_fail(!t, "couldn't create root node");
+    for(i = 1; i < num_nodes; i++)
+        node_bst_insert(t, int_node_new(ur(num_nodes)));
+
+    for(o = NODE_PRE_ORDER; o <= NODE_POST_ORDER; o++) {
+        order_len = 0;
+        recurse_order(t, o);
+
+        /*
+         * Stop halfway through and pick up where we left off.
+         */
+        node_iter_init(&it, t, o);
+        for(i = 0; i < num_nodes >> 1 && (n = node_iter_next(&it)); i++)
+            test_break(n != order_seen[i], "cursor order %d broke at %u", o, i);
+
+        for(; (n = node_iter_next(&it)); i++)
+            test_break(n != order_seen[i], "resumed order %d broke at %u", o, i);
+
+        test_try(i != num_nodes, "cursor visited %u nodes", i);
+
+        i = 0;
+        node_bt_loop(n, t, o)
+            test_break(n != order_seen[i++], "loop order %d broke", o);
+
+        /*
+         * Subtrees are traversed on their own.
+         */
+        n = node_at(t, NODE_LEFT);
+        order_len = 0;
+        recurse_order(n, o);
+        i = 0;
+        node_iter_init(&it, n, o);
+        while((prev = node_iter_next(&it)))
+            test_break(prev != order_seen[i++], "subtree order %d broke", o);
+
+        test_try(i != order_len, "subtree visit count is %u", i);
+    }
+
+    node_free_all(t);
+
+    /*
+     * A degenerate tree far too deep to recurse through.
+     */
+    t = prev = int_node_new(0);
+    for(i = 1; i < deep; i++) {
+        node_put(prev, NODE_RIGHT, n = int_node_new(i));
+        prev = n;
+    }
+
+    prev_int = -1; fail_flag = false; i = 0;
+    node_bt_loop(n, t, NODE_PRE_ORDER) {
+        confirm_ascended(n);
+        i++;
+    }
+
+    test_try(fail_flag || i != deep, "deep pre-order visit failed");
+
+    prev_int = -1; fail_flag = false;
+    node_in_order(t, confirm_ascended);
+    test_try(fail_flag, "deep in-order visit failed");
+
+    /*
+     * Post-order cursors let us free nodes as we go.
+     */
+    fail_flag = false;
+    node_iter_init(&it, t, NODE_POST_ORDER);
+    for(i = deep; (n = node_iter_next(&it)); i--) {
+        if(int_node_n(n) != i - 1)
+            fail_flag = true;
+
+        node_free_one(n);
+    }
+
+    test_try(fail_flag, "deep post-order visit failed");
+    test_try(i, "%u nodes weren't freed", i);
+}
+
+test_func(teardown)
+{
+    const unsigned deep = 100000, wide = 1000;
+    struct node_s *t = int_node_new(0), *n, *c = 0;
+    unsigned i;
+
+    test_fail(!t, "couldn't create root node");
+
+    /*
+     * A chain far too deep to free recursively, with a wide fan of
+     * children hanging off every so often.
+     */
+    for(i = 1, n = t; i < deep; i++, n = c) {
+        node_push(n, c = int_node_new(i));
+        if(!(i % (deep / 10)))
+            for(; c->len < wide; node_push(c, str_node_new("leaf")))
+                ;
+    }
+
+    test_try(int_node_n(n) != deep - 1, "chain is too short");
+
+    /*
+     * Freeing a subtree still takes it out of its owner's table.
+     */
+    c = node_at(t, 0);
+    node_push(t, int_node_new(-1));
+    node_free_all(c);
+    test_try(node_at(t, 0), "freed subtree is still owned");
+    test_try(t->len != 2, "owner table has the wrong length");
+
+    node_free_all(t);
+
+    /*
+     * Freeing just the node leaves its children without an owner.
+     */
+    t = int_node_new(0);
+    node_push(t, n = int_node_new(1));
+    node_push(t, c = int_node_new(2));
+    node_free_one(t);
+
+    test_try(n->owner || c->owner, "children still have an owner");
+    node_free_all(n);
+    node_free_all(c);
+}
+
+test_func(map)
+{
+    struct node_s *map = map_node_new(), *key, *n;
+    char s[32];
+    int i;
+
+    test_fail(!map, "couldn't create map");
+
+    /*
+     * Integer keys, each holding a string value, with room for them
+     * all reserved up front.
+     */
+    test_try(!node_map_reserve(map, 1000), "couldn't reserve map");
+    test_try(map_get(map->data)->max < 2000 || map->max < 1000,
+        "reserved map has %lu slots and a table of %lu",
+        map_get(map->data)->max, map->max);
+    size_t reserved = map_get(map->data)->max;
+
+    for(i = 0; i < 1000; i++) {
+        key = int_node_new(i);
+        sprintf(s, "value %d", i);
+        node_put(key, NODE_NEXT, str_node_new(s));
+        test_break(node_map_put(map, key), "key %d was already there", i);
+    }
+
+    test_try(map_len(map) != 1000, "map has %lu keys", map_len(map));
+    test_try(map->len != 1000, "map has %lu children", map->len);
+    test_try(map_get(map->data)->max != reserved,
+        "reserved index grew to %lu slots", map_get(map->data)->max);
+
+    for(i = 0; i < 1000; i++) {
+        key = int_node_new(i);
+        n = node_map_get(map, key);
+        node_free_all(key);
+        test_break(!n || int_node_n(n) != i, "couldn't find key %d", i);
+
+        sprintf(s, "value %d", i);
+        test_break(strcmp(str_node_buf(node_at(n, NODE_NEXT)), s),
+            "key %d has the wrong value", i);
+    }
+
+    /*
+     * Replacing a key hands back the old one.
+     */
+    key = int_node_new(500);
+    n = node_map_put(map, key);
+    test_try(!n || n->owner || int_node_n(n) != 500, "key wasn't replaced");
+    test_try(node_map_get(map, key) != key, "replacement isn't in the map");
+    test_try(map_len(map) != 1000, "replacing changed the map's length");
+    node_free_all(n);
+
+    /*
+     * Remove the odd keys. The remaining children stay packed together.
+     */
+    for(i = 1; i < 1000; i += 2) {
+        key = int_node_new(i);
+        n = node_map_remove(map, key);
+        test_break(!n || n->owner || int_node_n(n) != i,
+            "couldn't remove key %d", i);
+        test_break(node_map_get(map, key), "key %d is still there", i);
+        node_free_all(key);
+        node_free_all(n);
+    }
+
+    test_try(map->len != 500, "map has %lu children", map->len);
+    for(i = 0; i < map->len; i++)
+        test_break(!map->table[i] || map->table[i]->id != i ||
+            int_node_n(map->table[i]) & 1, "bad child at %d", i);
+
+    for(i = 0; i < 1000; i += 2) {
+        key = int_node_new(i);
+        n = node_map_get(map, key);
+        node_free_all(key);
+        test_break(!n || int_node_n(n) != i, "lost key %d", i);
+    }
+
+    node_free_all(map);
+
+    /*
+     * String keys, some of them interned.
+     */
+    map = map_node_new();
+    for(i = 0; i < 100; i++) {
+        sprintf(s, i & 1 ? "a long key number %d" : "key %d", i);
+        key = i % 3 ? str_node_new(s) : str_node_new_interned(s);
+        test_break(node_map_put(map, key), "string key %d was already there", i);
+    }
+
+    for(i = 0; i < 100; i++) {
+        sprintf(s, i & 1 ? "a long key number %d" : "key %d", i);
+        key = str_node_new(s);
+        n = node_map_get(map, key);
+        test_break(!n || node_diff(n, key), "couldn't find string key %d", i);
+        node_free_all(key);
+    }
+
+    key = int_node_new(0);
+    test_try(node_map_get(map, key), "found an integer among strings");
+    node_free_all(key);
+
+    node_free_all(map);
+}
+
+static char prev_str[32];
+
+/*
+ * Check that strings (or the strings rendered for other nodes) come
+ * in strictly ascending order.
+ */
+static void confirm_str_ascended(struct node_s *n)
+{
+    char *s = node_string(n);
+
+    if(*prev_str && strcmp(prev_str, s) >= 0)
+        fail_flag = true;
+
+    snprintf(prev_str, sizeof(prev_str), "%s", s);
+}
+
+/*
+ * A malloc-backed allocator which keeps count of what it hands out, so the
+ * allocator test can check that everything came from it and went back.
+ */
+struct test_alloc_s {
+    size_t allocs, frees;
+    long long bytes;
+    bool bad;
+};
+
+static void *test_alloc(void *ctx, size_t size)
+{
+    struct test_alloc_s *c = (struct test_alloc_s *) ctx;
+
+    c->allocs++;
+    c->bytes += size;
+    return malloc(size);
+}
+
+static void *test_realloc(void *ctx, void *p, size_t old, size_t size)
+{
+    struct test_alloc_s *c = (struct test_alloc_s *) ctx;
+
+    c->allocs += !p;
+    c->bytes += (long long) size - (long long) (p ? old : 0);
+    return realloc(p, size);
+}
+
+static void test_free(void *ctx, void *p, size_t size)
+{
+    struct test_alloc_s *c = (struct test_alloc_s *) ctx;
+
+    if(!p)
+        return;
+
+    c->frees++;
+    c->bytes -= size;
+    c->bad |= c->bytes < 0;
+    free(p);
+}
+
+test_func(allocator)
+{
+    struct test_alloc_s c = { 0 };
+    const struct node_allocator_s a = {
+        .alloc = test_alloc,
+        .realloc = test_realloc,
+        .free = test_free,
+        .ctx = &c,
+        .thread_safe = true
+    };
+    struct node_s *t, *m, *b, *s = 0, *n;
+    struct graph_s *f;
+    char buf[100];
+    size_t i;
+
+    t = node_new_with(&a, node_type_int, &(int) { 0 }, true);
+    test_fail(!t, "couldn't create node with allocator");
+    test_try(t->alloc != &a, "node doesn't remember its allocator");
+    test_try(!c.allocs, "allocator wasn't used");
+    test_try(node_allocator() != &node_allocator_heap,
+        "default allocator isn't the heap");
+
+    /*
+     * Everything created while the allocator is in use, and everything
+     * those nodes allocate later on, should come from it.
+     */
+    node_allocator_use(&a);
+    test_try(node_allocator() != &a, "thread allocator wasn't used");
+
+    m = map_node_new();
+    b = btree_node_new(node_type_int);
+    test_fail(!m || !b, "couldn't create map and btree");
+
+    for(i = 0; i < 1000; i++) {
+        snprintf(buf, sizeof(buf), "a string too long to fit inline %lu", i);
+        node_push(t, str_node_new(buf));
+        node_map_put(m, str_node_new(buf));
+        n = int_node_new((int) i);
+        node_btree_insert(b, n);
+        node_free_all(n);
+        stack_push(&s, t);
+    }
+
+    node_allocator_use(0);
+    test_try(node_allocator() != &node_allocator_heap,
+        "thread allocator wasn't reset");
+
+    n = int_node_new(0);
+    test_try(n->alloc != &node_allocator_heap, "heap node used the allocator");
+    node_free_all(n);
+
+    for(i = 0, fail_flag = false; i < t->len; i++)
+        if(node_at(t, i)->alloc != &a)
+            fail_flag = true;
+
+    test_try(fail_flag, "child node didn't use the allocator");
+    test_try(map_len(m) != 1000, "map has %lu entries", map_len(m));
+    test_try(btree_len(b) != 1000, "btree has %lu values", btree_len(b));
+
+    node_shrink_to_fit(t);
+    while(stack_pop(&s))
+        ;
+
+    /*
+     * A snapshot of a graph comes from the graph's allocator.
+     */
+    i = c.allocs;
+    f = node_graph_freeze(t);
+    test_try(!f || f->alloc != &a || c.allocs == i,
+        "snapshot didn't use the graph's allocator");
+    graph_free(f);
+
+    node_free_all(t);
+    node_free_all(m);
+    node_free_all(b);
+
+    test_try(c.bad, "more was freed than allocated");
+    test_try(c.allocs != c.frees, "%lu allocations but %lu frees",
+        c.allocs, c.frees);
+    test_try(c.bytes, "%lld bytes weren't freed", c.bytes);
+
+    /*
+     * The process-wide allocator applies to threads without their own.
+     */
+    node_allocator_set(&a);
+    n = int_node_new(0);
+    test_try(n->alloc != &a, "global allocator wasn't used");
+    node_free_all(n);
+    node_allocator_set(0);
+
+    test_try(c.bytes, "%lld bytes weren't freed", c.bytes);
+}
+
+test_func(shared)
+{
+    struct test_alloc_s c = { 0 };
+    const struct node_allocator_s a = {
+        .alloc = test_alloc,
+        .realloc = test_realloc,
+        .free = test_free,
+        .ctx = &c,
+        .thread_safe = true
+    };
+    char path[] = "/tmp/node_test_XXXXXX";
+    struct node_s *item, *x, *y, *k, *m, *n, *l;
+    size_t i;
+    int fd;
+
+    node_allocator_use(&a);
+
+    /*
+     * One item held by two tables and a map value at once.
+     */
+    item = node_share(str_node_new("a string held in several places"));
+    x = int_node_new(1);
+    y = int_node_new(2);
+    k = str_node_new("key");
+    m = map_node_new();
+    test_fail(!item || !x || !y || !k || !m, "couldn't create nodes");
+    test_try(item->refs != 1, "shared node has %u references", item->refs);
+
+    node_push(x, item);
+    node_push(y, item);
+    node_put(k, NODE_NEXT, item);
+    test_try(node_map_put(m, k), "couldn't add key to map");
+    test_try(node_map_put(m, item) != item, "added a shared node to a map");
+    test_try(item->refs != 4 || item->owner, "sharing took the item away");
+    test_try(node_at(x, 0) != item || node_at(y, 0) != item ||
+        node_at(k, NODE_NEXT) != item, "item isn't in every table");
+
+    node_unref(item);
+    node_free_all(x);
+    test_try(item->refs != 2 || strcmp(str_node_buf(item),
+        "a string held in several places"), "item was freed too soon");
+
+    /*
+     * Releasing hands the slot's reference over, and replacing drops it.
+     */
+    test_try(node_release(y, 0) != item || y->len || item->refs != 2,
+        "releasing a shared node went wrong");
+    node_push(y, item);
+    node_put(y, 0, int_node_new(3));
+    test_try(item->refs != 2, "replacing a shared node kept its reference");
+    node_free_all(node_new_node(item));
+    test_try(item->refs != 1, "nested node didn't drop its reference");
+    node_free_all(y);
+
+    /*
+     * A node which already has an owner keeps its slot as its reference.
+     */
+    x = int_node_new(4);
+    node_push(x, int_node_new(5));
+    n = node_ref(node_at(x, 0));
+    test_try(n->refs != 2 || n->owner || node_at(x, 0) != n,
+        "sharing an owned node went wrong");
+    node_free_one(x);
+    test_try(n->refs != 2, "freeing just the owner dropped its reference");
+    node_unref(n);
+    node_unref(n);
+
+    /*
+     * A diamond, whose bottom holds a subtree of its own, goes away with
+     * its top.
+     */
+    x = int_node_new(6);
+    n = node_share(int_node_new(7));
+    for(i = 0; i < 100; i++)
+        node_push(n, str_node_new("a string below the shared node"));
+
+    for(i = 0; i < 2; i++) {
+        node_push(x, int_node_new((int) i));
+        node_push(node_at(x, i), n);
+    }
+
+    node_unref(n);
+
+    /*
+     * Shared nodes are saved once and come back shared.
+     */
+    fd = mkstemp(path);
+    test_fail(fd < 0, "couldn't create test file");
+    close(fd);
+
+    node_push(x, node_new_node(node_ref(n)));
+    test_try(!node_save(x, path), "couldn't save shared nodes");
+    l = node_load(path);
+    test_fail(!l, "couldn't load shared nodes");
+    test_try(node_at(node_at(l, 0), 0) != node_at(node_at(l, 1), 0) ||
+        node_data(node_at(l, 2)) != node_at(node_at(l, 0), 0),
+        "loaded shared node isn't shared");
+    test_try(node_at(node_at(l, 0), 0)->refs != 3 ||
+        node_at(node_at(l, 0), 0)->len != 100,
+        "loaded shared node has the wrong references or children");
+    node_free_all(l);
+    unlink(path);
+
+    node_free_all(x);
+    node_free_all(m);
+    node_allocator_use(0);
+
+    test_try(c.bad, "more was freed than allocated");
+    test_try(c.allocs != c.frees, "%lu allocations but %lu frees",
+        c.allocs, c.frees);
+    test_try(c.bytes, "%lld bytes weren't freed", c.bytes);
+}
+
+test_func(btree_set)
+{
+    const int num_values = 20000;
+    struct node_s *t = btree_node_new(node_type_int), *v, *lo, *hi;
+    bool *in = (bool *) calloc(num_values, sizeof(bool));
+    size_t len = 0, k;
+    int i, j;
+
+    test_fail(!t || !in, "couldn't create btree");
+    test_try(btree_node_new(node_type_node), "created btree of nodes");
+
+    /*
+     * Random inserts and deletes, checked against a plain array.
+     */
+    for(i = 0; i < 200000; i++) {
+        j = (int) ur(num_values - 1);
+        v = int_node_new(j);
+
+        if(ur(2)) {
+            if(node_btree_insert(t, v) == in[j])
+                fail_flag = true;
+
+            len += !in[j];
+            in[j] = true;
+        } else {
+            if(node_btree_delete(t, v) != in[j])
+                fail_flag = true;
+
+            len -= in[j];
+            in[j] = false;
+        }
+
+        node_free_all(v);
+    }
+
+    test_try(fail_flag, "insert or delete misreported");
+    test_try(btree_len(t) != len, "btree has %lu values, not %lu",
+        btree_len(t), len);
+
+    for(i = 0, fail_flag = false; i < num_values; i++) {
+        v = int_node_new(i);
+        if(!node_btree_find(t, v) != !in[i])
+            fail_flag = true;
+
+        node_free_all(v);
+    }
+
+    test_try(fail_flag, "find disagrees with inserts and deletes");
+
+    fail_flag = false;
+    prev_int = -1;
+    test_try(node_btree_for_each(t, confirm_ascended) != len,
+        "for_each visited the wrong number of values");
+    test_try(fail_flag, "btree is out of order");
+
+    /*
+     * Ranges, including rendering each value.
+     */
+    lo = int_node_new(num_values / 4);
+    hi = int_node_new(num_values / 2);
+    for(i = num_values / 4, k = 0; i <= num_values / 2; i++)
+        k += in[i];
+
+    fail_flag = false;
+    *prev_str = 0;
+    test_try(node_btree_range(t, lo, hi, 0) != k, "range counted wrong");
+    node_btree_range(t, lo, 0, confirm_str_ascended);
+    node_btree_range(t, 0, hi, 0);
+    test_try(node_btree_range(t, hi, lo, 0), "empty range isn't empty");
+    node_free_all(lo);
+    node_free_all(hi);
+
+    /*
+     * Emptying the tree frees all of its pages.
+     */
+    for(i = 0; i < num_values; i++) {
+        v = int_node_new(i);
+        node_btree_delete(t, v);
+        node_free_all(v);
+    }
+
+    test_try(btree_len(t) || btree_get(t->data)->root,
+        "emptied btree isn't empty");
+    node_free_all(t);
+    free(in);
+
+    /*
+     * String values, with small pages and so a deeper tree.
+     */
+    char s[32];
+
+    t = btree_node_new(node_type_str);
+    for(i = 0; i < 5000; i++) {
+        sprintf(s, i & 1 ? "%08d" : "a longer string %08d", (int) ur(2000));
+        v = str_node_new(s);
+        node_btree_insert(t, v);
+        node_free_all(v);
+    }
+
+    test_try(btree_get(t->data)->height < 3, "string btree is too shallow");
+
+    fail_flag = false;
+    *prev_str = 0;
+    node_btree_for_each(t, confirm_str_ascended);
+    test_try(fail_flag, "string btree is out of order");
+
+    for(i = 0; i < 1000; i++) {
+        sprintf(s, "%08d", (int) ur(2000));
+        v = str_node_new(s);
+        node_btree_delete(t, v);
+        node_free_all(v);
+    }
+
+    fail_flag = false;
+    *prev_str = 0;
+    node_btree_for_each(t, confirm_str_ascended);
+    test_try(fail_flag, "string btree is out of order after deletes");
+
+    node_free_all(t);
+}
+
+test_func(policy)
+{
+    const struct node_policy_s min16 = { 16, 2, 4 };
+    struct node_s *t = int_node_new(0), **table;
+    unsigned i;
+
+    test_fail(!t, "couldn't create node");
+
+    /*
+     * Presized tables aren't reallocated as they fill up.
+     */
+    test_try(node_reserve(t, 1000) != 1000, "couldn't reserve room");
+    table = t->table;
+    for(i = 0; i < 1000; i++)
+        node_push(t, int_node_new(i));
+
+    test_try(t->table != table, "reserved table was reallocated");
+
+    /*
+     * Tables which never shrink keep their room after emptying out.
+     */
+    t->policy = &node_policy_keep;
+    for(i = 0; i < 1000; i++)
+        node_free_all(node_pop(t));
+
+    test_try(t->max != 1000, "table shrank to %lu", t->max);
+    test_try(node_shrink_to_fit(t) || t->table, "table wasn't freed");
+
+    /*
+     * Tables with a minimum size don't go below it.
+     */
+    t->policy = &min16;
+    node_push(t, int_node_new(1));
+    test_try(t->max != 16, "table grew to %lu", t->max);
+    for(i = 0; i < 100; i++)
+        node_push(t, int_node_new(i));
+
+    for(i = 0; i < 101; i++)
+        node_free_all(node_pop(t));
+
+    test_try(t->max != 16, "table shrank to %lu", t->max);
+
+    node_push(t, int_node_new(1));
+    node_push(t, int_node_new(2));
+    test_try(node_shrink_to_fit(t) != 2, "table wasn't shrunk to fit");
+    test_try(t->len != 2, "shrinking changed the table length");
+
+    node_free_all(t);
+}
+
+int main(int argc, char const *argv[])
+{
+    init_random();
+    struct test_result_s global_tr = test_result_new("global");
+    unsigned i;
+    double start;
+
+    printf("Running %s tests\n", global_tr.name);
+    for(i = 0; i < TEST_ROUNDS; i++) {
+        start = test_now_ms();
+
+        test_run(basic);
+        test_run(list);
+        test_run(stack);
+        test_run(queue);
+        test_run(deque);
+        test_run(lfq);
+        test_run(graph);
+        test_run(table);
+        test_run(btree);
+        test_run(pool);
+        test_run(inline);
+        test_run(render);
+        test_run(sso);
+        test_run(strcmp);
+        test_run(intern);
+        test_run(avl);
+        test_run(order);
+        test_run(specialized);
+        test_run(build);
+        test_run(traverse);
+        test_run(teardown);
+        test_run(policy);
+        test_run(map);
+        test_run(btree_set);
+        test_run(allocator);
+        test_run(frozen);
+        test_run(paths);
+        test_run(serial);
+        test_run(import);
+        test_run(shared);
+
+        global_tr.ms += test_now_ms() - start;
+        printf("round %u took %.2f ms\n", i + 1, test_now_ms() - start);
     }
 
     test_summarize(&global_tr);